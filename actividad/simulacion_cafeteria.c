@@ -2,8 +2,26 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
+#include <limits.h>
 #include <math.h>
 #include <omp.h>
+#include "gate.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
+#endif
 
 // =======================
 // DEFINICIONES GENERALES
@@ -17,13 +35,15 @@
 // =======================
 // PARÁMETROS GENERALES
 // =======================
-#define T_MIN      180.0  // Tiempo total simulado en minutos
+#define T_MIN      180.0  // Horizonte por defecto en minutos (-horizonte / -dias)
 #define DT         0.25   // Paso de simulación en minutos
 #define R          24     // Número de réplicas (simulaciones independientes)
 #define N_CAJA     2      // Número de cajeros
 #define N_HOT      2      // Número de baristas calientes
 #define N_COLD     1      // Número de baristas fríos
-#define UMBRAL_LEN 50     // Umbral máximo de clientes en cola antes de abandono
+#define UMBRAL_LEN 50     // Umbral máximo de clientes en cola; los últimos en llegar se van
+#define PACIENCIA  0.0    // Paciencia media en una cola en minutos (0 = infinita)
+#define MAX_SRV    16     // Tope de servidores por estación al configurar en ejecución
 
 // Tipos de producto (puedes ajustar a tu menú)
 enum Tipo { ESPRESSO=0, AMERICANO, LATTE, TEA, FRAPPE, SMOOTHIE, TIPO_COUNT };
@@ -45,25 +65,181 @@ static const double MU_COLD[TIPO_COUNT] = { 0, 0, 0, 0, 1.0/1.0, 1.0/1.1 };
 static const double MEZCLA[TIPO_COUNT]  = { 0.18, 0.18, 0.24, 0.15, 0.15, 0.10 };
 
 // Llegadas por minuto: base con un pico entre 60..120 min
-static void llenar_lambda(double *lambda, int ticks){
-    for(int i=0;i<ticks;i++){
-        double t = i*DT;
-        double base = 1.2, pico = 2.8;           // ajusta estos valores si quieres
-        lambda[i] = (t>=60 && t<=120)? pico : base; // clientes/minuto
+#define LAMBDA_BASE 1.2
+#define LAMBDA_PICO 2.8
+
+// Perfil de demanda: tasa (clientes/min) lineal entre puntos (t, tasa); dos
+// puntos con el mismo t forman un escalón. Con periodo>0 el perfil se repite
+// (1440 = un día, 10080 = una semana) y el último tramo es constante hasta el
+// fin del periodo; sin periodo la última tasa sigue para siempre. Ocupa lo que
+// el archivo, no lo que el horizonte.
+typedef struct { int n; double periodo; double *t, *tasa; } Perfil;
+
+// Agrega un punto; sin memoria devuelve false y deja el perfil como estaba
+static bool perfil_punto(Perfil *p, int *cap, double t, double tasa){
+    if(p->n==*cap){
+        int nc = *cap? 2*(*cap) : 16;
+        double *nt = (double*)realloc(p->t, sizeof(double)*nc);
+        if(!nt) return false;
+        p->t = nt;
+        double *ntasa = (double*)realloc(p->tasa, sizeof(double)*nc);
+        if(!ntasa) return false;
+        p->tasa = ntasa; *cap = nc;
+    }
+    p->t[p->n]=t; p->tasa[p->n]=tasa; p->n++;
+    return true;
+}
+static void perfil_liberar(Perfil *p){ free(p->t); free(p->tasa); p->t=p->tasa=NULL; p->n=0; }
+
+// Perfil por defecto: base con pico en [60, 120] (mismo reparto que los ticks de DT)
+static bool perfil_pico(Perfil *p, double base, double pico){
+    int cap=0; p->n=0; p->periodo=0.0; p->t=p->tasa=NULL;
+    bool ok = perfil_punto(p, &cap, 0.0, base) && perfil_punto(p, &cap, 60.0, base)
+           && perfil_punto(p, &cap, 60.0, pico) && perfil_punto(p, &cap, 120.0+DT, pico)
+           && perfil_punto(p, &cap, 120.0+DT, base);
+    if(!ok){ fprintf(stderr, "perfil: sin memoria\n"); perfil_liberar(p); }
+    return ok;
+}
+
+// Archivo de texto: líneas "minuto tasa" en orden no decreciente, comentarios
+// con '#' y opcionalmente "periodo P". Si el primer punto no está en 0 se
+// extiende su tasa hacia atrás. Cualquier otra línea no vacía es un error (con
+// archivo:línea): saltarla cambiaría el proceso de llegadas sin avisar.
+// Devuelve false (con mensaje) si es inválido.
+static bool perfil_cargar(const char *ruta, Perfil *p){
+    FILE *f = fopen(ruta, "r");
+    if(!f){ fprintf(stderr, "no se pudo abrir %s\n", ruta); return false; }
+    int cap=0, nl=0; char linea[256]; bool ok=true;
+    p->n=0; p->periodo=0.0; p->t=p->tasa=NULL;
+    while(ok && fgets(linea, sizeof(linea), f)){
+        nl++;
+        char *c = strchr(linea, '#');
+        if(!strchr(linea, '\n') && !feof(f)){                         // no cupo en el búfer
+            if(!c){ fprintf(stderr, "%s:%d: línea demasiado larga\n", ruta, nl); ok=false; break; }
+            int ch; while((ch = fgetc(f)) != EOF && ch != '\n');        // el resto es comentario
+        }
+        if(c) *c = '\0';
+        double t, tasa; int usado = 0;
+        char *resto = linea + strspn(linea, " \t\r\n");
+        if(*resto == '\0') continue;                                   // vacía o solo comentario
+        if(!strncmp(resto, "periodo", 7)){
+            if(sscanf(resto, "periodo %lf %n", &p->periodo, &usado)!=1 || resto[usado]!='\0' || p->periodo<0.0){
+                fprintf(stderr, "%s:%d: se esperaba \"periodo P\" con P >= 0\n", ruta, nl); ok=false; break;
+            }
+            continue;
+        }
+        if(sscanf(resto, "%lf %lf %n", &t, &tasa, &usado)!=2 || resto[usado]!='\0'
+           || tasa<0.0 || t<0.0 || (p->n>0 && t<p->t[p->n-1])){
+            fprintf(stderr, "%s:%d: se esperaba \"minuto tasa\" con minuto creciente y tasa >= 0\n", ruta, nl);
+            ok=false; break;
+        }
+        if((p->n==0 && t>0.0 && !perfil_punto(p, &cap, 0.0, tasa)) || !perfil_punto(p, &cap, t, tasa)){
+            fprintf(stderr, "%s:%d: sin memoria para el perfil\n", ruta, nl); ok=false; break;
+        }
+    }
+    fclose(f);
+    if(ok && p->n==0){ fprintf(stderr, "%s: perfil sin puntos\n", ruta); ok=false; }
+    if(ok && p->periodo>0.0 && p->periodo<=p->t[p->n-1]){
+        fprintf(stderr, "%s: periodo %.2f no cubre el último punto (%.2f)\n", ruta, p->periodo, p->t[p->n-1]); ok=false;
     }
+    if(!ok) perfil_liberar(p);
+    return ok;
 }
 
+// Llegadas esperadas en [0, T]: integral exacta de la tasa lineal por tramos,
+// recorriendo los tramos (y periodos) igual que llegadas_avanzar
+static double perfil_integral(const Perfil *p, double T){
+    double acc=0.0, base=0.0;
+    for(int k=0;;){
+        double t0 = base + p->t[k], l0 = p->tasa[k], fin, l1;
+        if(k+1 < p->n){ fin = base + p->t[k+1]; l1 = p->tasa[k+1]; }
+        else { fin = (p->periodo>0.0)? base + p->periodo : INFINITY; l1 = l0; }
+        if(t0 >= T) break;
+        double b = (fin < T)? fin : T;
+        if(b > t0){
+            double lb = (fin==INFINITY)? l0 : l0 + (l1-l0)*(b-t0)/(fin-t0);
+            acc += 0.5*(l0+lb)*(b-t0);
+        }
+        if(fin >= T) break;
+        if(k+1 < p->n) k++;
+        else { k = 0; base += p->periodo; }
+    }
+    return acc;
+}
+
+// Configuración de personal y demanda. Los macros de arriba son los valores por
+// defecto; el modo -sweep recorre rangos de estos campos sin recompilar.
+typedef struct {
+    int    n_caja, n_hot, n_cold, umbral;
+    double lambda_base, lambda_pico;  // solo para el perfil por defecto
+    double paciencia;                 // media de la paciencia ~Exp (0 = infinita)
+    const Perfil *perfil;             // tasa de llegadas en el tiempo
+    double horizonte;                 // minutos simulados
+} Config;
+
 // =======================
 // GENERADOR DE NÚMEROS ALEATORIOS
 // =======================
-typedef struct { uint64_t s; } RNG;         // generador sencillo
-static inline uint64_t rotl(const uint64_t x, int k){ return (x<<k)|(x>>(64-k)); }
-static inline void rng_seed(RNG *r, uint64_t seed){ r->s = seed? seed : 88172645463393265ull; }
-static inline uint64_t xorshift64s(RNG *r){
-    uint64_t x=r->s; x^=x>>12; x^=x<<25; x^=x>>27; r->s=x; return x*2685821657736338717ull;
+// Philox4x32-10 (Salmon et al., 2011): generador basado en contador. El sorteo
+// número n de un flujo es una función pura de (llave, n), así que:
+//   - cada (réplica, flujo) tiene su propia llave y los flujos no se solapan;
+//   - saltar a cualquier posición cuesta O(1) (rng_saltar);
+//   - el resultado no depende de qué hilo ni en qué orden se sortea.
+// Los sorteos se generan por ventanas de RNG_VENTANA (bloques consecutivos);
+// el sorteo n sale del bloque n/2 como siempre, solo cambia cuántos se
+// calculan de una vez. El motor SIMD carga las ventanas de sus carriles juntas
+// (rng_cargar_carriles).
+#define SEMILLA 1234567u                    // semilla global (24 bits, va en la llave)
+#define RNG_VENTANA 16                      // sorteos por ventana (8 bloques de 2)
+
+typedef struct {
+    uint32_t k0, k1;                        // llave: réplica y (semilla, flujo)
+    uint64_t n;                             // índice del próximo sorteo de 64 bits
+    uint64_t ven;                           // ventana cargada en buf (n/RNG_VENTANA), ~0 si ninguna
+    uint64_t inv;                           // ~0 en la réplica antitética: cada sorteo sale complementado
+    uint64_t buf[RNG_VENTANA];
+} RNG;
+
+// Las 10 rondas de Philox4x32 sobre (c0,c1,c2,c3) con llave (k0,k1), en
+// palabras de 32 bits y sin ramas: la misma macro sirve al sorteo escalar y al
+// lazo simd de rng_cargar_carriles, donde cada posición es un contador
+#define PHILOX10(c0,c1,c2,c3,k0,k1) \
+    for(int i_=0;i_<10;i_++){ \
+        uint64_t p0_ = (uint64_t)0xD2511F53u * c0, p1_ = (uint64_t)0xCD9E8D57u * c2; \
+        uint32_t n0_ = (uint32_t)(p1_>>32) ^ c1 ^ k0, n2_ = (uint32_t)(p0_>>32) ^ c3 ^ k1; \
+        c0=n0_; c1=(uint32_t)p1_; c2=n2_; c3=(uint32_t)p0_; \
+        k0 += 0x9E3779B9u; k1 += 0xBB67AE85u; \
+    }
+static inline void philox_ventana(RNG *r, uint64_t w){
+    for(int j=0;j<RNG_VENTANA/2;j++){
+        uint64_t b = w*(RNG_VENTANA/2) + j;
+        uint32_t c0=(uint32_t)b, c1=(uint32_t)(b>>32), c2=0, c3=0, k0=r->k0, k1=r->k1;
+        PHILOX10(c0,c1,c2,c3,k0,k1)
+        r->buf[2*j]   = ((uint64_t)c1<<32) | c0;
+        r->buf[2*j+1] = ((uint64_t)c3<<32) | c2;
+    }
+    r->ven = w;
+}
+static inline void rng_init(RNG *r, uint32_t replica, uint32_t flujo){
+    r->k0 = replica; r->k1 = (SEMILLA<<8) | (flujo & 0xFFu); r->n = 0; r->inv = 0; r->ven = ~(uint64_t)0;
 }
-static inline double urand(RNG *r){        // número uniforme (0,1)
-    return ( (xorshift64s(r)>>11) * (1.0/9007199254740992.0) );
+static inline void rng_saltar(RNG *r, uint64_t n){  // ir al sorteo n en O(1)
+    r->n = n;                                       // la ventana se carga al sortear
+}
+static inline uint64_t rng_next(RNG *r){
+    uint64_t w = r->n / RNG_VENTANA;
+    if(w != r->ven) philox_ventana(r, w);
+    return r->buf[r->n++ % RNG_VENTANA] ^ r->inv;
+}
+static inline double urand(RNG *r){        // número uniforme [0,1)
+    return ( (rng_next(r)>>11) * (1.0/9007199254740992.0) );
+}
+// Réplicas antitéticas (-antiteticas): la réplica 2k+1 usa las llaves de la 2k
+// con cada sorteo complementado, así su uniforme es 1-u (menos 2^-53).
+static bool ANTITETICAS = false;
+static inline void rng_replica(RNG *r, int r_id, uint32_t flujo){
+    rng_init(r, (uint32_t)(ANTITETICAS? (r_id & ~1) : r_id), flujo);
+    if(ANTITETICAS && (r_id & 1)) r->inv = ~(uint64_t)0;
 }
 static double expo(double mu, RNG *r){     // tiempo de servicio ~ Exponencial
     double u=urand(r); if(u<=0.0) u=1e-12; return -log(u)/mu;
@@ -82,10 +258,180 @@ static int poisson_knuth(double lambda, RNG *r){         // # de llegadas en un
     double L=exp(-lambda), p=1.0; int k=0; do{ k++; p*=urand(r);}while(p>L); return k-1;
 }
 
+// =======================
+// MUESTREADORES RÁPIDOS
+// =======================
+// Reemplazan a expo/categorical/poisson_knuth en el camino caliente; las
+// versiones de arriba se quedan como referencia para -bench_muestreo.
+
+// Ziggurat de Marsaglia y Tsang (2000) con índices de 8 bits y magnitud de 56
+// bits tomados de un solo sorteo de 64 bits. Casi siempre sale con un producto
+// y una comparación; log/exp solo en la cuña o la cola.
+#define ZIG_M     72057594037927936.0   // 2^56
+#define ZIG_RE    7.69711747013104972   // borde de la capa base (exponencial, 256 capas)
+#define ZIG_VE    3.949659822581572e-3
+#define ZIG_RN    3.442619855899        // borde de la capa base (normal, 128 capas)
+#define ZIG_VN    9.91256303526217e-3
+
+static uint64_t zig_ke[256]; static double zig_we[256], zig_fe[256];
+static uint64_t zig_kn[128]; static double zig_wn[128], zig_fn[128];
+
+static void zig_init(void){
+    double de=ZIG_RE, te=de, q=ZIG_VE/exp(-de);
+    zig_ke[0]=(uint64_t)((de/q)*ZIG_M); zig_ke[1]=0;
+    zig_we[0]=q/ZIG_M; zig_we[255]=de/ZIG_M;
+    zig_fe[0]=1.0; zig_fe[255]=exp(-de);
+    for(int i=254;i>=1;i--){
+        de=-log(ZIG_VE/de + exp(-de));
+        zig_ke[i+1]=(uint64_t)((de/te)*ZIG_M); te=de;
+        zig_fe[i]=exp(-de); zig_we[i]=de/ZIG_M;
+    }
+
+    double dn=ZIG_RN, tn=dn; q=ZIG_VN/exp(-0.5*dn*dn);
+    zig_kn[0]=(uint64_t)((dn/q)*ZIG_M); zig_kn[1]=0;
+    zig_wn[0]=q/ZIG_M; zig_wn[127]=dn/ZIG_M;
+    zig_fn[0]=1.0; zig_fn[127]=exp(-0.5*dn*dn);
+    for(int i=126;i>=1;i--){
+        dn=sqrt(-2.0*log(ZIG_VN/dn + exp(-0.5*dn*dn)));
+        zig_kn[i+1]=(uint64_t)((dn/tn)*ZIG_M); tn=dn;
+        zig_fn[i]=exp(-0.5*dn*dn); zig_wn[i]=dn/ZIG_M;
+    }
+}
+
+static inline double expo_zig(RNG *r){      // Exponencial(1)
+    // Con antitéticas se invierte la CDF: un sorteo por muestra y monótona en u,
+    // así la pareja no se desfasa por los rechazos del zigurat
+    if(ANTITETICAS) return -log(1.0-urand(r));
+    for(;;){
+        uint64_t u=rng_next(r); int i=(int)(u & 0xFF); uint64_t j=u>>8;
+        double x=j*zig_we[i];
+        if(j<zig_ke[i]) return x;
+        if(i==0) return ZIG_RE - log(1.0-urand(r));     // cola: r + Exp(1)
+        if(zig_fe[i] + urand(r)*(zig_fe[i-1]-zig_fe[i]) < exp(-x)) return x;
+    }
+}
+
+static inline double normal_zig(RNG *r){    // Normal(0,1)
+    for(;;){
+        uint64_t u=rng_next(r); int i=(int)(u & 0x7F); int neg=(int)((u>>7)&1); uint64_t j=u>>8;
+        double x=j*zig_wn[i];
+        if(j<zig_kn[i]) return neg? -x : x;
+        if(i==0){                                         // cola más allá de ZIG_RN
+            double y;
+            do{ x=-log(1.0-urand(r))/ZIG_RN; y=-log(1.0-urand(r)); }while(y+y < x*x);
+            return neg? -(ZIG_RN+x) : ZIG_RN+x;
+        }
+        if(zig_fn[i] + urand(r)*(zig_fn[i-1]-zig_fn[i]) < exp(-0.5*x*x)) return neg? -x : x;
+    }
+}
+
+// Tabla de alias de Walker (construcción de Vose): un sorteo por muestra sin
+// importar el número de categorías.
+typedef struct { int n; double prob[TIPO_COUNT]; int alias[TIPO_COUNT]; } Alias;
+static Alias ALIAS_MEZCLA;
+
+static void alias_init(Alias *a, const double *p, int n){
+    double tot=0.0, esc[TIPO_COUNT]; int peq[TIPO_COUNT], gra[TIPO_COUNT], np=0, ng=0;
+    for(int i=0;i<n;i++) tot+=p[i];
+    a->n=n;
+    for(int i=0;i<n;i++){ esc[i]=p[i]*n/tot; if(esc[i]<1.0) peq[np++]=i; else gra[ng++]=i; }
+    while(np>0 && ng>0){
+        int s=peq[--np], g=gra[--ng];
+        a->prob[s]=esc[s]; a->alias[s]=g;
+        esc[g]=(esc[g]+esc[s])-1.0;
+        if(esc[g]<1.0) peq[np++]=g; else gra[ng++]=g;
+    }
+    while(ng>0){ int g=gra[--ng]; a->prob[g]=1.0; a->alias[g]=g; }
+    while(np>0){ int s=peq[--np]; a->prob[s]=1.0; a->alias[s]=s; }   // residuos de redondeo
+}
+static inline int alias_sample(const Alias *a, RNG *r){
+    double x=urand(r)*a->n; int i=(int)x;
+    return (x-i < a->prob[i])? i : a->alias[i];
+}
+
+// Poisson exacto: inversión secuencial (un solo uniforme) para tasas chicas y
+// PTRS de Hörmann (1993) para lambda >= 10, en vez de la aproximación normal.
+static int poisson_ptrs(double lambda, RNG *r){
+    double slam=sqrt(lambda), loglam=log(lambda);
+    double b=0.931 + 2.53*slam, a=-0.059 + 0.02483*b;
+    double invalpha=1.1239 + 1.1328/(b-3.4), vr=0.9277 - 3.6224/(b-2.0);
+    for(;;){
+        double U=urand(r)-0.5, V=urand(r), us=0.5-fabs(U);
+        double k=floor((2.0*a/us + b)*U + lambda + 0.43);
+        if(us>=0.07 && V<=vr) return (int)k;
+        if(k<0.0 || (us<0.013 && V>us)) continue;
+        if(log(V) + log(invalpha) - log(a/(us*us)+b) <= -lambda + k*loglam - lgamma(k+1.0)) return (int)k;
+    }
+}
+static int poisson_rapido(double lambda, RNG *r){
+    if(lambda<=0) return 0;
+    if(lambda>=10.0) return poisson_ptrs(lambda, r);
+    double p=exp(-lambda), F=p, u=urand(r); int k=0;
+    while(u>F && k<1000){ k++; p*=lambda/k; F+=p; }
+    return k;
+}
+
+static void muestreo_init(void){
+    zig_init();
+    alias_init(&ALIAS_MEZCLA, MEZCLA, TIPO_COUNT);
+}
+
+// =======================
+// LLEGADAS POR ADELGAZAMIENTO
+// =======================
+// Lewis y Shedler (1979): en cada tramo del perfil se sortean candidatos de un
+// Poisson homogéneo con la cota max(tasa) del tramo y cada uno se acepta con
+// probabilidad tasa(t)/cota. Si un candidato cruza el fin del tramo se vuelve
+// a sortear desde ahí (falta de memoria). En tramos constantes se acepta sin
+// sortear y los de tasa 0 se saltan enteros, así que el costo es O(clientes +
+// tramos recorridos) y no depende de DT ni del horizonte.
+typedef struct {
+    const Perfil *p;
+    int    k;        // tramo actual
+    double base;     // inicio del periodo en curso
+    double prox;     // instante de la próxima llegada (INFINITY si ya no hay)
+    int    replica, n; // réplica y clientes ya creados (identidad para la traza)
+} Llegadas;
+
+static void llegadas_avanzar(Llegadas *a, RNG *r){
+    const Perfil *p = a->p;
+    double t = a->prox;
+    for(;;){
+        int k = a->k;
+        double t0 = a->base + p->t[k], l0 = p->tasa[k], fin, l1;
+        if(k+1 < p->n){ fin = a->base + p->t[k+1]; l1 = p->tasa[k+1]; }
+        else { fin = (p->periodo>0.0)? a->base + p->periodo : INFINITY; l1 = l0; }
+        double cota = (l0>l1)? l0 : l1;
+        if(cota > 0.0){
+            double tn = t + expo_zig(r)/cota;
+            if(tn < fin){
+                t = tn;
+                if(l0==l1 || urand(r)*cota <= l0 + (l1-l0)*(tn-t0)/(fin-t0)){ a->prox = tn; return; }
+                continue;
+            }
+        }
+        if(fin == INFINITY){ a->prox = INFINITY; return; }
+        t = fin;
+        if(k+1 < p->n) a->k = k+1;
+        else { a->k = 0; a->base += p->periodo; }
+    }
+}
+static void llegadas_init(Llegadas *a, const Perfil *p, RNG *r, int r_id){
+    a->p=p; a->k=0; a->base=0.0; a->prox=0.0; a->replica=r_id; a->n=0;
+    llegadas_avanzar(a, r);
+}
+
 // =======================
 // ESTRUCTURAS DE DATOS
 // =======================
-typedef struct Cliente { double t_llegada; int tipo; double t_fin_caja; } Cliente;
+typedef struct Cliente {
+    double t_llegada, t_fin_caja;
+    double w_caja, w_barra;        // trabajo ~Exp(1); servicio = w/mu
+    double paciencia;              // minutos que aguanta en cada cola (INFINITY = no se va)
+    int tipo;
+    int tick;                      // tick en que entró a la cola actual
+    int replica, id;               // para la traza: réplica y orden de llegada en ella
+} Cliente;
 
 typedef struct Servidor {          // representa un cajero o barista
     bool   ocupado;                // está atendiendo a alguien
@@ -93,43 +439,682 @@ typedef struct Servidor {          // representa un cajero o barista
     Cliente c;                     // a quién atiende
 } Servidor;
 
-// Cola circular con bloqueo
-typedef struct { Cliente *buf; int cap, head, tail, size; omp_lock_t lock; } Cola;
-static void cola_init(Cola *q, int cap){
-    q->buf=(Cliente*)malloc(sizeof(Cliente)*cap); q->cap=cap; q->head=q->tail=q->size=0; omp_init_lock(&q->lock);
+// Estaciones de una réplica (también indexan sus flujos aleatorios)
+enum Estacion { EST_LLEGADAS=0, EST_CAJA, EST_HOT, EST_COLD, EST_COUNT };
+
+// Acumulados de una réplica (o de una estación dentro de ella)
+typedef struct { double ventas, espera; int compl, aband, llegadas; } Resultado;
+
+static inline void resultado_sumar(Resultado *a, const Resultado *b){
+    a->ventas += b->ventas; a->espera += b->espera; a->compl += b->compl; a->aband += b->aband;
+    a->llegadas += b->llegadas;
+}
+
+// =======================
+// TRAZA POR CLIENTE
+// =======================
+// -traza archivo: cada paso de cada cliente (llegada, inicio y fin en caja y
+// en barra, abandono) se anota como un evento de ancho fijo en un búfer del
+// hilo que lo produce, ya separado por columnas. El búfer lleno se entrega a
+// un escritor en segundo plano que lo vuelca como un chunk y lo devuelve
+// vacío; si el disco no da abasto los hilos esperan un búfer libre (tope
+// TRAZA_BUFS), así la memoria queda acotada.
+//
+// Archivo (little-endian, todo alineado a 8 para poder mapearlo con mmap):
+//   TrazaCab (64 B)
+//   chunks: TrazaChunk (48 B) seguido de sus TRAZA_COLS columnas, cada una
+//           rellenada a múltiplo de 8 (bytes[c] ya incluye el relleno)
+//   índice: 'chunks' desplazamientos uint64 de las cabeceras de chunk
+// Columnas: replica u32, cliente u32 (orden de llegada en la réplica),
+// t f64 (min), evento u8 (EventoTraza), bebida u8 (Tipo). Sin compresión cada
+// columna es el arreglo crudo de n elementos; con -traza_comprimir los enteros
+// van como deltas zigzag en LEB128, t como XOR con el anterior en LEB128 y
+// evento/bebida quedan crudos. Los tiempos son los del motor (al tick en los
+// motores por ticks); un recorte por umbral se anota al tick en que ocurre.
+enum EventoTraza { TR_LLEGADA=0, TR_INICIO_CAJA, TR_FIN_CAJA, TR_INICIO_BARRA, TR_FIN_BARRA, TR_ABANDONO, TR_COUNT };
+static const char *NOMBRES_TRAZA[TR_COUNT] = { "llegada", "inicio_caja", "fin_caja", "inicio_barra", "fin_barra", "abandono" };
+#define TRAZA_CAP        16384     // eventos por búfer (= máximo por chunk)
+#define TRAZA_BUFS       64        // búferes vivos antes de frenar a los productores
+#define TRAZA_COLS       5
+#define TRAZA_COMPRIMIDA 1u
+static const uint8_t TRAZA_ANCHO[TRAZA_COLS] = { 4, 4, 8, 1, 1 };
+
+typedef struct {
+    char     magia[8];                      // "CAFTRZ01"
+    uint32_t version, ncol, flags, cap_chunk;
+    uint64_t eventos, chunks, off_indice;
+    uint8_t  ancho[8];                      // bytes por elemento de cada columna sin comprimir
+    uint64_t reservado;
+} TrazaCab;
+typedef struct { uint32_t n, flags; uint64_t bytes[TRAZA_COLS]; } TrazaChunk;
+
+// Hilo escritor, candado y condiciones: pthreads, o Win32 (CreateThread con
+// CRITICAL_SECTION/CONDITION_VARIABLE, como los codificadores de proyecto.c)
+#ifdef _WIN32
+typedef HANDLE             TrzHilo;
+typedef CRITICAL_SECTION   TrzMutex;
+typedef CONDITION_VARIABLE TrzCond;
+static inline void trz_lock(TrzMutex *m){ EnterCriticalSection(m); }
+static inline void trz_unlock(TrzMutex *m){ LeaveCriticalSection(m); }
+static inline void trz_wait(TrzCond *c, TrzMutex *m){ SleepConditionVariableCS(c, m, INFINITE); }
+static inline void trz_signal(TrzCond *c){ WakeConditionVariable(c); }
+static inline void trz_broadcast(TrzCond *c){ WakeAllConditionVariable(c); }
+#else
+typedef pthread_t       TrzHilo;
+typedef pthread_mutex_t TrzMutex;
+typedef pthread_cond_t  TrzCond;
+static inline void trz_lock(TrzMutex *m){ pthread_mutex_lock(m); }
+static inline void trz_unlock(TrzMutex *m){ pthread_mutex_unlock(m); }
+static inline void trz_wait(TrzCond *c, TrzMutex *m){ pthread_cond_wait(c, m); }
+static inline void trz_signal(TrzCond *c){ pthread_cond_signal(c); }
+static inline void trz_broadcast(TrzCond *c){ pthread_cond_broadcast(c); }
+#endif
+
+typedef struct TrazaBuf {
+    struct TrazaBuf *sig, *todos;           // cola/lista libre y lista de todos los búferes
+    int      n;
+    uint32_t replica[TRAZA_CAP], cliente[TRAZA_CAP];
+    double   t[TRAZA_CAP];
+    uint8_t  evento[TRAZA_CAP], bebida[TRAZA_CAP];
+} TrazaBuf;
+
+static struct {
+    bool      activa, comprimir, fin, error;
+    int       gen;                          // cambia en cada apertura: invalida búferes de hilo viejos
+    FILE     *f;
+    uint64_t  off, eventos, chunks, *indice;
+    int       cap_indice;
+    TrazaBuf *cab, *cola, *libres, *todos;
+    int       vivos, pendientes, esperas;
+    double    seg_escritor;
+    uint8_t  *tmp;                          // chunk codificado antes de escribirlo
+    TrzHilo   hilo;
+    TrzMutex  m;
+    TrzCond   hay_lleno, hay_libre;
+} TRZ;
+static TrazaBuf *traza_buf = NULL;          // búfer del hilo
+static int traza_gen = 0;
+#pragma omp threadprivate(traza_buf, traza_gen)
+
+static inline uint8_t *leb128(uint8_t *p, uint64_t v){
+    while(v>=0x80){ *p++ = (uint8_t)(v|0x80); v >>= 7; }
+    *p++ = (uint8_t)v; return p;
+}
+static inline const uint8_t *leb128_leer(const uint8_t *p, uint64_t *v){
+    uint64_t x=0; int s=0; uint8_t b;
+    do{ b=*p++; x |= (uint64_t)(b&0x7F)<<s; s+=7; }while(b&0x80);
+    *v=x; return p;
+}
+static inline uint64_t zigzag(int64_t d){ return ((uint64_t)d<<1) ^ (uint64_t)(d>>63); }
+
+// Codifica la columna c del búfer en dst y la rellena a 8; devuelve los bytes
+static size_t traza_columna(const TrazaBuf *b, int c, bool comprimir, uint8_t *dst){
+    const void *src[TRAZA_COLS] = { b->replica, b->cliente, b->t, b->evento, b->bebida };
+    uint8_t *p = dst;
+    if(!comprimir || c>=3){ memcpy(p, src[c], (size_t)b->n*TRAZA_ANCHO[c]); p += (size_t)b->n*TRAZA_ANCHO[c]; }
+    else if(c<2){
+        const uint32_t *v = (const uint32_t*)src[c]; int64_t prev=0;
+        for(int i=0;i<b->n;i++){ p = leb128(p, zigzag((int64_t)v[i]-prev)); prev=v[i]; }
+    }else{
+        uint64_t prev=0;
+        for(int i=0;i<b->n;i++){ uint64_t x; memcpy(&x, &b->t[i], 8); p = leb128(p, x^prev); prev=x; }
+    }
+    while((p-dst) & 7) *p++ = 0;
+    return (size_t)(p-dst);
+}
+
+// Escribe un búfer como chunk (solo un hilo a la vez: el escritor o el cierre).
+// Devuelve false si falló; TRZ.error lo marca quien llama, bajo el candado si
+// los productores siguen vivos (ellos también lo escriben).
+static bool traza_volcar(TrazaBuf *b){
+    TrazaChunk ch = { (uint32_t)b->n, TRZ.comprimir? TRAZA_COMPRIMIDA : 0u, {0} };
+    size_t tot = 0; bool ok = true;
+    for(int c=0;c<TRAZA_COLS;c++){ ch.bytes[c] = traza_columna(b, c, TRZ.comprimir, TRZ.tmp + tot); tot += ch.bytes[c]; }
+    if(fwrite(&ch, sizeof(ch), 1, TRZ.f)!=1 || fwrite(TRZ.tmp, 1, tot, TRZ.f)!=tot) ok = false;
+    if(TRZ.chunks == (uint64_t)TRZ.cap_indice){
+        int cap = TRZ.cap_indice? 2*TRZ.cap_indice : 256;
+        uint64_t *ind = (uint64_t*)realloc(TRZ.indice, sizeof(uint64_t)*cap);
+        if(!ind){ b->n = 0; return false; }                 // sin índice el chunk no se encontraría
+        TRZ.indice = ind; TRZ.cap_indice = cap;
+    }
+    TRZ.indice[TRZ.chunks++] = TRZ.off;
+    TRZ.off += sizeof(ch) + tot; TRZ.eventos += b->n;
+    b->n = 0;
+    return ok;
+}
+
+static void traza_escribir(void){
+    trz_lock(&TRZ.m);
+    for(;;){
+        while(!TRZ.cab && !TRZ.fin) trz_wait(&TRZ.hay_lleno, &TRZ.m);
+        TrazaBuf *b = TRZ.cab;
+        if(!b) break;
+        TRZ.cab = b->sig; if(!TRZ.cab) TRZ.cola = NULL;
+        trz_unlock(&TRZ.m);
+        double t0 = omp_get_wtime();
+        bool ok = traza_volcar(b);
+        TRZ.seg_escritor += omp_get_wtime() - t0;
+        trz_lock(&TRZ.m);
+        if(!ok) TRZ.error = true;
+        b->sig = TRZ.libres; TRZ.libres = b; TRZ.pendientes--;
+        trz_broadcast(&TRZ.hay_libre);
+    }
+    trz_unlock(&TRZ.m);
+}
+#ifdef _WIN32
+static DWORD WINAPI traza_escritor(LPVOID arg){ (void)arg; traza_escribir(); return 0; }
+#else
+static void *traza_escritor(void *arg){ (void)arg; traza_escribir(); return NULL; }
+#endif
+
+// Entrega el búfer lleno (si hay) y devuelve uno vacío para el hilo. Solo se
+// espera si hay chunks pendientes que el escritor va a liberar. Sin memoria
+// para un búfer nuevo devuelve NULL: la traza queda marcada con error y los
+// eventos de ese hilo se pierden hasta que consiga uno.
+static TrazaBuf *traza_tomar(TrazaBuf *lleno){
+    trz_lock(&TRZ.m);
+    if(lleno){
+        lleno->sig = NULL;
+        if(TRZ.cola) TRZ.cola->sig = lleno; else TRZ.cab = lleno;
+        TRZ.cola = lleno; TRZ.pendientes++;
+        trz_signal(&TRZ.hay_lleno);
+    }
+    if(!TRZ.libres && TRZ.vivos>=TRAZA_BUFS && TRZ.pendientes>0){
+        TRZ.esperas++;
+        while(!TRZ.libres && TRZ.pendientes>0) trz_wait(&TRZ.hay_libre, &TRZ.m);
+    }
+    TrazaBuf *b = TRZ.libres;
+    if(b) TRZ.libres = b->sig;
+    else if((b = (TrazaBuf*)malloc(sizeof(TrazaBuf)))){ b->todos = TRZ.todos; TRZ.todos = b; TRZ.vivos++; }
+    else TRZ.error = true;
+    trz_unlock(&TRZ.m);
+    if(b){ b->n = 0; b->sig = NULL; }
+    return b;
+}
+
+static inline void traza_evento(const Cliente *c, int ev, double t){
+    if(!TRZ.activa || c->replica<0) return;
+    TrazaBuf *b = traza_buf;
+    if(!b || traza_gen!=TRZ.gen){ b = traza_buf = traza_tomar(NULL); traza_gen = TRZ.gen; }
+    else if(b->n==TRAZA_CAP) b = traza_buf = traza_tomar(b);
+    if(!b) return;
+    int i = b->n++;
+    b->replica[i] = (uint32_t)c->replica; b->cliente[i] = (uint32_t)c->id; b->t[i] = t;
+    b->evento[i] = (uint8_t)ev; b->bebida[i] = (uint8_t)c->tipo;
+}
+
+static bool traza_abrir(const char *ruta, bool comprimir){
+    TrazaCab cab; memset(&cab, 0, sizeof(cab));
+    FILE *f = fopen(ruta, "wb");
+    if(!f){ fprintf(stderr, "no se pudo abrir %s\n", ruta); return false; }
+    if(fwrite(&cab, sizeof(cab), 1, f)!=1){ fclose(f); return false; }   // se reescribe al cerrar
+    int gen = TRZ.gen + 1;
+    memset(&TRZ, 0, sizeof(TRZ));
+    TRZ.gen = gen; TRZ.f = f; TRZ.off = sizeof(cab); TRZ.comprimir = comprimir;
+    TRZ.tmp = (uint8_t*)malloc((size_t)TRAZA_COLS*(TRAZA_CAP*10 + 8));
+    if(!TRZ.tmp){ fprintf(stderr, "traza: sin memoria\n"); fclose(f); TRZ.f = NULL; return false; }
+#ifdef _WIN32
+    InitializeCriticalSection(&TRZ.m); InitializeConditionVariable(&TRZ.hay_lleno); InitializeConditionVariable(&TRZ.hay_libre);
+    TRZ.hilo = CreateThread(NULL, 0, traza_escritor, NULL, 0, NULL);
+    bool hilo_ok = TRZ.hilo!=NULL;
+    if(!hilo_ok) DeleteCriticalSection(&TRZ.m);      // las CONDITION_VARIABLE no se destruyen
+#else
+    pthread_mutex_init(&TRZ.m, NULL); pthread_cond_init(&TRZ.hay_lleno, NULL); pthread_cond_init(&TRZ.hay_libre, NULL);
+    bool hilo_ok = pthread_create(&TRZ.hilo, NULL, traza_escritor, NULL)==0;
+    if(!hilo_ok){ pthread_mutex_destroy(&TRZ.m); pthread_cond_destroy(&TRZ.hay_lleno); pthread_cond_destroy(&TRZ.hay_libre); }
+#endif
+    if(!hilo_ok){
+        fprintf(stderr, "traza: no se pudo lanzar el hilo escritor\n");
+        fclose(f); free(TRZ.tmp); TRZ.f = NULL; TRZ.tmp = NULL;
+        return false;
+    }
+    TRZ.activa = true;
+    return true;
+}
+
+// Cierra la traza: drena al escritor, vuelca los búferes a medio llenar de los
+// hilos, escribe el índice y la cabecera. Se llama fuera de regiones paralelas.
+static bool traza_cerrar(void){
+    if(!TRZ.activa) return false;
+    TRZ.activa = false;
+    trz_lock(&TRZ.m); TRZ.fin = true; trz_signal(&TRZ.hay_lleno); trz_unlock(&TRZ.m);
+#ifdef _WIN32
+    WaitForSingleObject(TRZ.hilo, INFINITE); CloseHandle(TRZ.hilo);
+    DeleteCriticalSection(&TRZ.m);
+#else
+    pthread_join(TRZ.hilo, NULL);
+    pthread_mutex_destroy(&TRZ.m); pthread_cond_destroy(&TRZ.hay_lleno); pthread_cond_destroy(&TRZ.hay_libre);
+#endif
+    for(TrazaBuf *b=TRZ.todos; b; b=b->todos) if(b->n>0 && !traza_volcar(b)) TRZ.error = true;   // ya sin escritor
+
+    TrazaCab cab; memset(&cab, 0, sizeof(cab));
+    memcpy(cab.magia, "CAFTRZ01", 8);
+    cab.version = 1; cab.ncol = TRAZA_COLS; cab.flags = TRZ.comprimir? TRAZA_COMPRIMIDA : 0u; cab.cap_chunk = TRAZA_CAP;
+    cab.eventos = TRZ.eventos; cab.chunks = TRZ.chunks; cab.off_indice = TRZ.off;
+    memcpy(cab.ancho, TRAZA_ANCHO, TRAZA_COLS);
+    if(TRZ.chunks && fwrite(TRZ.indice, sizeof(uint64_t), TRZ.chunks, TRZ.f)!=TRZ.chunks) TRZ.error = true;
+    if(fseek(TRZ.f, 0, SEEK_SET)!=0 || fwrite(&cab, sizeof(cab), 1, TRZ.f)!=1) TRZ.error = true;
+    if(fclose(TRZ.f)!=0) TRZ.error = true;
+    TRZ.off += TRZ.chunks*sizeof(uint64_t);
+
+    for(TrazaBuf *b=TRZ.todos, *s; b; b=s){ s=b->todos; free(b); }
+    TRZ.todos = TRZ.libres = TRZ.cab = TRZ.cola = NULL;
+    free(TRZ.indice); free(TRZ.tmp); TRZ.indice = NULL; TRZ.tmp = NULL;
+    return !TRZ.error;
+}
+
+// -leer_traza archivo: mapea el archivo y recorre los chunks por el índice. Sin
+// compresión las columnas se leen en su lugar (cero copias); comprimidas se
+// decodifican a arreglos temporales. Cuenta eventos por tipo y por bebida.
+static int traza_leer(const char *ruta){
+#ifdef _WIN32
+    fprintf(stderr, "-leer_traza usa mmap (no disponible en Windows)\n"); (void)ruta;
+    return 1;
+#else
+    int fd = open(ruta, O_RDONLY);
+    struct stat st;
+    if(fd<0 || fstat(fd, &st)!=0 || (size_t)st.st_size < sizeof(TrazaCab)){ fprintf(stderr, "no se pudo leer %s\n", ruta); if(fd>=0) close(fd); return 1; }
+    const uint8_t *base = (const uint8_t*)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(base==MAP_FAILED){ perror("mmap"); return 1; }
+    const TrazaCab *cab = (const TrazaCab*)base;
+    if(memcmp(cab->magia, "CAFTRZ01", 8)!=0 || cab->ncol!=TRAZA_COLS ||
+       cab->off_indice + cab->chunks*sizeof(uint64_t) > (uint64_t)st.st_size){
+        fprintf(stderr, "%s: no es una traza válida\n", ruta); munmap((void*)base, (size_t)st.st_size); return 1;
+    }
+    const uint64_t *ind = (const uint64_t*)(base + cab->off_indice);
+    uint32_t *rep = (uint32_t*)malloc(sizeof(uint32_t)*cab->cap_chunk);
+    double   *td  = (double*)malloc(sizeof(double)*cab->cap_chunk);
+    if(!rep || !td){
+        fprintf(stderr, "%s: sin memoria para decodificar\n", ruta);
+        free(rep); free(td); munmap((void*)base, (size_t)st.st_size); return 1;
+    }
+    uint64_t por_ev[TR_COUNT] = {0}, por_beb[TIPO_COUNT] = {0}, n = 0;
+    uint32_t rmax = 0; double tmax = 0.0;
+
+    double t0 = omp_get_wtime();
+    for(uint64_t k=0;k<cab->chunks;k++){
+        const TrazaChunk *ch = (const TrazaChunk*)(base + ind[k]);
+        const uint8_t *col[TRAZA_COLS], *p = (const uint8_t*)(ch+1);
+        for(int c=0;c<TRAZA_COLS;c++){ col[c] = p; p += ch->bytes[c]; }
+        const uint32_t *r = (const uint32_t*)col[0];
+        const double *t = (const double*)col[2];
+        if(ch->flags & TRAZA_COMPRIMIDA){
+            const uint8_t *q = col[0]; int64_t prev = 0; uint64_t v;
+            for(uint32_t i=0;i<ch->n;i++){ q = leb128_leer(q, &v); prev += (int64_t)(v>>1) ^ -(int64_t)(v&1); rep[i] = (uint32_t)prev; }
+            q = col[2]; uint64_t x = 0;
+            for(uint32_t i=0;i<ch->n;i++){ q = leb128_leer(q, &v); x ^= v; memcpy(&td[i], &x, 8); }
+            r = rep; t = td;
+        }
+        for(uint32_t i=0;i<ch->n;i++){
+            por_ev[col[3][i] < TR_COUNT? col[3][i] : 0]++;
+            por_beb[col[4][i] < TIPO_COUNT? col[4][i] : 0]++;
+            if(r[i] > rmax) rmax = r[i];
+            if(t[i] > tmax) tmax = t[i];
+        }
+        n += ch->n;
+    }
+    double seg = omp_get_wtime() - t0;
+
+    printf("traza %s: %llu eventos en %llu chunks%s, %.2f MB (%.2f B/evento), replicas=%u, t_max=%.2f min\n", ruta,
+           (unsigned long long)n, (unsigned long long)cab->chunks, (cab->flags & TRAZA_COMPRIMIDA)? " comprimidos" : "",
+           st.st_size/1048576.0, n? (double)st.st_size/n : 0.0, n? rmax+1 : 0, tmax);
+    for(int e=0;e<TR_COUNT;e++) printf("  %s=%llu\n", NOMBRES_TRAZA[e], (unsigned long long)por_ev[e]);
+    printf("  por bebida:");
+    for(int b=0;b<TIPO_COUNT;b++) printf(" %llu", (unsigned long long)por_beb[b]);
+    printf("\n  lectura %.3f s (%.1f Meventos/s)\n", seg, seg>0.0? n/seg/1e6 : 0.0);
+    bool ok = (n==cab->eventos);
+    free(rep); free(td);
+    munmap((void*)base, (size_t)st.st_size);
+    return ok? 0 : 1;
+#endif
+}
+
+// =======================
+// COLAS CON PACIENCIA
+// =======================
+// Cada cliente en cola tiene un límite (entrada + paciencia) y se va al
+// vencerlo, esté donde esté. Los límites van en una rueda de temporizadores
+// jerárquica (Varghese y Lauck, 1987): RUEDA_NIV niveles de RUEDA_RAN cubetas,
+// el nivel k agrupa ticks de RUEDA_RES en bloques de RUEDA_RAN^k. Insertar y
+// cancelar (al empezar el servicio) es O(1) con listas doblemente enlazadas;
+// avanzar la rueda cuesta O(1) por tick más O(1) por cliente que vence o baja
+// de nivel. Quien se va deja su ranura muerta y la cabeza la salta después.
+//
+// Las ranuras se identifican por su posición absoluta (head..tail), no por el
+// índice en el arreglo, así los enlaces siguen válidos cuando el anillo crece.
+#define RUEDA_RES  DT
+#define RUEDA_BITS 6
+#define RUEDA_RAN  (1<<RUEDA_BITS)
+#define RUEDA_NIV  4
+#define RUEDA_MAX  ((int64_t)1 << (RUEDA_BITS*RUEDA_NIV - 1))   // más lejos = sin límite
+
+typedef struct {
+    Cliente c;
+    double  limite;               // instante en que se va si sigue esperando
+    int64_t sig, ant;             // enlaces en su cubeta (posiciones; -1 = ninguna)
+    int16_t cubeta;               // nivel*RUEDA_RAN + índice; -1 = fuera de la rueda
+    bool    vivo;                 // false = se fue desde el medio de la cola
+} Ranura;
+
+// Cola sin candado: la usan directamente los carriles SIMD (un solo hilo)
+typedef struct {
+    Ranura  *r;
+    int64_t cap, head, tail;      // cap potencia de 2; ranura = pos & (cap-1)
+    int     size;                 // clientes vivos
+    int64_t ahora;                // tick de la rueda ya procesado
+    int     en_rueda;
+    int64_t cub[RUEDA_NIV*RUEDA_RAN];
+} ColaBase;
+
+static inline Ranura *cb_ranura(ColaBase *q, int64_t pos){ return &q->r[pos & (q->cap-1)]; }
+
+static void cb_init(ColaBase *q, int cap){
+    q->cap=16; while(q->cap<cap) q->cap*=2;
+    q->r=(Ranura*)malloc(sizeof(Ranura)*q->cap);
+    q->head=q->tail=0; q->size=0; q->ahora=0; q->en_rueda=0;
+    for(int i=0;i<RUEDA_NIV*RUEDA_RAN;i++) q->cub[i]=-1;
+}
+static void cb_free(ColaBase *q){ free(q->r); }
+
+static void rueda_insertar(ColaBase *q, int64_t pos){
+    Ranura *x = cb_ranura(q, pos);
+    x->cubeta = -1;
+    double d = x->limite/RUEDA_RES;
+    if(!(d < (double)(q->ahora + RUEDA_MAX))) return;       // INFINITY o muy lejos: nunca vence
+    int64_t e = (int64_t)d;
+    if(e < q->ahora) e = q->ahora;
+    // Nivel = primer bloque en que e y ahora coinciden en los bits de arriba
+    int64_t dif = e ^ q->ahora; int niv = 0;
+    while(niv < RUEDA_NIV-1 && (dif >> (RUEDA_BITS*(niv+1)))) niv++;
+    int cb = niv*RUEDA_RAN + (int)((e >> (RUEDA_BITS*niv)) & (RUEDA_RAN-1));
+    x->cubeta=(int16_t)cb; x->ant=-1; x->sig=q->cub[cb];
+    if(x->sig>=0) cb_ranura(q, x->sig)->ant = pos;
+    q->cub[cb]=pos; q->en_rueda++;
+}
+static void rueda_quitar(ColaBase *q, int64_t pos){
+    Ranura *x = cb_ranura(q, pos);
+    if(x->cubeta<0) return;
+    if(x->ant>=0) cb_ranura(q, x->ant)->sig = x->sig; else q->cub[x->cubeta] = x->sig;
+    if(x->sig>=0) cb_ranura(q, x->sig)->ant = x->ant;
+    x->cubeta=-1; q->en_rueda--;
+}
+// Saca al cliente del medio de la cola: fuera de la rueda y ranura muerta
+static inline void cb_retirar(ColaBase *q, int64_t pos){
+    rueda_quitar(q, pos); cb_ranura(q, pos)->vivo=false; q->size--;
+}
+
+static void cb_crecer(ColaBase *q){
+    int64_t ncap = 2*q->cap;
+    Ranura *nr = (Ranura*)malloc(sizeof(Ranura)*ncap);
+    for(int64_t p=q->head;p<q->tail;p++) nr[p & (ncap-1)] = q->r[p & (q->cap-1)];
+    free(q->r); q->r=nr; q->cap=ncap;
+}
+static void cb_push(ColaBase *q, const Cliente *c, double limite){
+    if(q->tail - q->head == q->cap) cb_crecer(q);
+    int64_t pos = q->tail++;
+    Ranura *x = cb_ranura(q, pos);
+    x->c=*c; x->limite=limite; x->vivo=true;
+    rueda_insertar(q, pos);
+    q->size++;
+}
+// Saca la cabeza viva solo si entró en un tick anterior a tick_limite
+static bool cb_pop_listo(ColaBase *q, int tick_limite, Cliente *out){
+    while(q->head<q->tail && !cb_ranura(q, q->head)->vivo) q->head++;
+    if(q->size==0 || cb_ranura(q, q->head)->c.tick>=tick_limite) return false;
+    rueda_quitar(q, q->head);
+    *out = cb_ranura(q, q->head)->c; q->head++; q->size--;
+    return true;
+}
+// Con más de umbral clientes se van los últimos que llegaron (con paciencia) o
+// los de la cabeza, como en el modelo base (sin paciencia); devuelve cuántos
+static int cb_recortar(ColaBase *q, int umbral, bool paciencia){
+    int n=0;
+    while(q->size > 0 && q->size > umbral){       // con size 0 no quedan vivos que buscar
+        int64_t pos;
+        if(paciencia){ while(!cb_ranura(q, q->tail-1)->vivo) q->tail--; pos = --q->tail; }
+        else         { while(!cb_ranura(q, q->head)->vivo) q->head++;   pos = q->head++; }
+        traza_evento(&cb_ranura(q, pos)->c, TR_ABANDONO, q->ahora*RUEDA_RES);
+        cb_retirar(q, pos); n++;
+    }
+    return n;
+}
+// Se van todos los que tienen limite <= t; devuelve cuántos
+static int cb_vencer(ColaBase *q, double t){
+    int64_t cur = (int64_t)floor(t/RUEDA_RES);
+    int n = 0;
+    while(q->ahora < cur){
+        if(q->en_rueda==0){ q->ahora = cur; break; }
+        // Todo lo que quedó en la cubeta de 'ahora' vence antes de t
+        int64_t *c0 = &q->cub[q->ahora & (RUEDA_RAN-1)];
+        while(*c0>=0){ traza_evento(&cb_ranura(q, *c0)->c, TR_ABANDONO, cb_ranura(q, *c0)->limite); cb_retirar(q, *c0); n++; }
+        q->ahora++;
+        // Al completar un bloque, la cubeta que empieza baja de nivel (de arriba a abajo)
+        for(int niv=RUEDA_NIV-1; niv>=1; niv--){
+            if(q->ahora & (((int64_t)1 << (RUEDA_BITS*niv)) - 1)) continue;
+            int cb = niv*RUEDA_RAN + (int)((q->ahora >> (RUEDA_BITS*niv)) & (RUEDA_RAN-1));
+            int64_t pos = q->cub[cb]; q->cub[cb] = -1;
+            while(pos>=0){
+                Ranura *x = cb_ranura(q, pos); int64_t sig = x->sig;
+                x->cubeta=-1; q->en_rueda--;
+                rueda_insertar(q, pos);
+                pos = sig;
+            }
+        }
+    }
+    // Tick en curso: solo los que ya vencieron
+    for(int64_t pos = q->cub[cur & (RUEDA_RAN-1)]; pos>=0; ){
+        Ranura *x = cb_ranura(q, pos); int64_t sig = x->sig;
+        if(x->limite <= t){ traza_evento(&x->c, TR_ABANDONO, x->limite); cb_retirar(q, pos); n++; }
+        pos = sig;
+    }
+    return n;
+}
+
+// Cola con bloqueo para los motores donde varias estaciones la comparten
+typedef struct { ColaBase b; omp_lock_t lock; } Cola;
+static void cola_init(Cola *q, int cap){ cb_init(&q->b, cap); omp_init_lock(&q->lock); }
+static void cola_free(Cola *q){ cb_free(&q->b); omp_destroy_lock(&q->lock); }
+static inline bool cola_empty(Cola *q){ return q->b.size==0; }
+static inline int  cola_len(Cola *q){ return q->b.size; }
+static void cola_enqueue(Cola *q, Cliente c, double limite){
+    omp_set_lock(&q->lock); cb_push(&q->b, &c, limite); omp_unset_lock(&q->lock);
+}
+// Saca la cabeza solo si entró en un tick anterior a tick_limite (entrega con sello de tick)
+static bool cola_dequeue_listo(Cola *q, int tick_limite, Cliente *out){
+    omp_set_lock(&q->lock); bool ok = cb_pop_listo(&q->b, tick_limite, out); omp_unset_lock(&q->lock);
+    return ok;
+}
+static bool cola_dequeue(Cola *q, Cliente *out){ return cola_dequeue_listo(q, INT_MAX, out); }
+static int cola_recortar(Cola *q, int umbral, bool paciencia){
+    omp_set_lock(&q->lock); int n = cb_recortar(&q->b, umbral, paciencia); omp_unset_lock(&q->lock);
+    return n;
+}
+static int cola_vencer(Cola *q, double t){
+    omp_set_lock(&q->lock); int n = cb_vencer(&q->b, t); omp_unset_lock(&q->lock);
+    return n;
+}
+
+// =======================
+// MÉTRICAS: HISTOGRAMAS Y SERIES POR TICK
+// =======================
+// Histograma logarítmico tipo HDR: 2^HDR_SUB_BITS sub-cubetas lineales por cada
+// potencia de dos, así el error relativo de un percentil es <= 1/2^HDR_SUB_BITS
+// con un arreglo fijo y una inserción O(1) sin log().
+#define HDR_SUB_BITS 5
+#define HDR_SUB      (1<<HDR_SUB_BITS)
+#define HDR_POT      32
+#define HDR_CUBETAS  (HDR_POT*HDR_SUB)
+#define HDR_UNIDAD   1e-3                 // resolución: 0.001 min
+
+typedef struct { uint64_t n; uint64_t c[HDR_CUBETAS]; } Histo;
+
+static inline void histo_add(Histo *h, double x){
+    uint64_t v = (x>0.0)? (uint64_t)(x/HDR_UNIDAD) : 0;
+    int idx;
+    if(v < HDR_SUB) idx = (int)v;
+    else {
+        int msb = 63 - __builtin_clzll(v), e = msb - HDR_SUB_BITS + 1;
+        idx = e*HDR_SUB + (int)((v >> (e-1)) - HDR_SUB);
+        if(idx >= HDR_CUBETAS) idx = HDR_CUBETAS-1;
+    }
+    h->c[idx]++; h->n++;
+}
+static void histo_merge(Histo *a, const Histo *b){
+    a->n += b->n;
+    for(int i=0;i<HDR_CUBETAS;i++) a->c[i] += b->c[i];
+}
+// Valor representativo (punto medio) de una cubeta, en minutos
+static double histo_valor(int idx){
+    if(idx < HDR_SUB) return idx*HDR_UNIDAD;
+    int e = idx/HDR_SUB; uint64_t m = (uint64_t)(idx%HDR_SUB + HDR_SUB);
+    uint64_t lo = m << (e-1), ancho = (uint64_t)1 << (e-1);
+    return (lo + 0.5*ancho)*HDR_UNIDAD;
+}
+static double histo_percentil(const Histo *h, double p){
+    if(h->n==0) return 0.0;
+    uint64_t objetivo = (uint64_t)ceil(p*h->n), acc=0;
+    if(objetivo<1) objetivo=1;
+    for(int i=0;i<HDR_CUBETAS;i++){ acc += h->c[i]; if(acc>=objetivo) return histo_valor(i); }
+    return histo_valor(HDR_CUBETAS-1);
+}
+
+// Columnas de la serie por tick (sumas sobre réplicas y ticks de la fila; se
+// promedian al volcar). Con horizontes largos varios ticks comparten fila para
+// que la memoria no crezca con el horizonte.
+#define SERIE_FILAS_MAX 4096
+enum ColSerie { SER_COLA_CAJA=0, SER_COLA_HOT, SER_COLA_COLD, SER_UTIL_CAJA, SER_UTIL_HOT, SER_UTIL_COLD, SER_COLS };
+
+// Métricas de un hilo: histogramas de espera por estación (caja en EST_CAJA,
+// barras en EST_HOT/EST_COLD para que los hilos del pipeline no compartan) y
+// serie por tick preasignada al inicio. NULL en las réplicas = sin métricas.
+typedef struct {
+    Histo   h[EST_COUNT];
+    int     ticks, paso, filas; // paso = ticks por fila de la serie
+    double *serie;              // [filas][SER_COLS]
+} Metricas;
+
+static Metricas *metricas_crear(int n, int ticks){
+    Metricas *m = (Metricas*)calloc(n, sizeof(Metricas));
+    int paso = (ticks + SERIE_FILAS_MAX - 1)/SERIE_FILAS_MAX, filas = (ticks + paso - 1)/paso;
+    for(int i=0;i<n;i++){
+        m[i].ticks=ticks; m[i].paso=paso; m[i].filas=filas;
+        m[i].serie=(double*)calloc((size_t)filas*SER_COLS, sizeof(double));
+    }
+    return m;
+}
+static void metricas_liberar(Metricas *m, int n){
+    for(int i=0;i<n;i++) free(m[i].serie);
+    free(m);
+}
+// Junta las métricas de todos los hilos en m[0]
+static void metricas_juntar(Metricas *m, int n){
+    for(int i=1;i<n;i++){
+        for(int s=0;s<EST_COUNT;s++) histo_merge(&m[0].h[s], &m[i].h[s]);
+        for(long k=0;k<(long)m[0].filas*SER_COLS;k++) m[0].serie[k] += m[i].serie[k];
+    }
+}
+
+static inline int ocupados(const Servidor *s, int n){ int k=0; for(int i=0;i<n;i++) k+=s[i].ocupado; return k; }
+
+// Sin clientes en colas ni servidores: los ticks hasta la próxima llegada no
+// cambian nada y los motores por tick los saltan.
+static inline bool replica_vacia(const Config *cfg, Cola *q_caja, Cola *q_hot, Cola *q_cold,
+                                 const Servidor *cajas, const Servidor *hot, const Servidor *cold){
+    return cola_empty(q_caja) && cola_empty(q_hot) && cola_empty(q_cold) &&
+           !ocupados(cajas, cfg->n_caja) && !ocupados(hot, cfg->n_hot) && !ocupados(cold, cfg->n_cold);
+}
+// Tick desde el que hay que seguir si la réplica quedó vacía al final de it
+static inline int tick_siguiente(int it, int ticks, double prox){
+    if(prox >= ticks*DT) return ticks;
+    int sig = (int)(prox/DT);
+    return (sig > it+1)? sig : it+1;
 }
-static void cola_free(Cola *q){ free(q->buf); omp_destroy_lock(&q->lock); }
-static inline bool cola_empty(Cola *q){ return q->size==0; }
-static inline int  cola_len(Cola *q){ return q->size; }
-static bool cola_enqueue(Cola *q, Cliente c){
-    bool ok=false; omp_set_lock(&q->lock);
-    if(q->size<q->cap){ q->buf[q->tail]=c; q->tail=(q->tail+1)%q->cap; q->size++; ok=true; }
-    omp_unset_lock(&q->lock); return ok;
+
+// Foto del estado: largo de colas y fracción de servidores ocupados
+static inline void serie_foto(double v[SER_COLS], const Config *cfg, Cola *q_caja, Cola *q_hot, Cola *q_cold,
+                              const Servidor *cajas, const Servidor *hot, const Servidor *cold){
+    v[SER_COLA_CAJA] = cola_len(q_caja); v[SER_COLA_HOT] = cola_len(q_hot); v[SER_COLA_COLD] = cola_len(q_cold);
+    v[SER_UTIL_CAJA] = (double)ocupados(cajas, cfg->n_caja)/cfg->n_caja;
+    v[SER_UTIL_HOT]  = (double)ocupados(hot,   cfg->n_hot)/cfg->n_hot;
+    v[SER_UTIL_COLD] = (double)ocupados(cold,  cfg->n_cold)/cfg->n_cold;
+}
+// Suma la misma foto a los ticks [it0, it1), una vez por fila tocada
+static inline void serie_sumar(Metricas *m, int it0, int it1, const double v[SER_COLS]){
+    if(it1 > m->ticks) it1 = m->ticks;
+    while(it0 < it1){
+        int fila = it0/m->paso, hasta = (fila+1)*m->paso;
+        if(hasta > it1) hasta = it1;
+        double *f = &m->serie[(size_t)fila*SER_COLS], w = hasta - it0;
+        for(int c=0;c<SER_COLS;c++) f[c] += w*v[c];
+        it0 = hasta;
+    }
 }
-static bool cola_dequeue(Cola *q, Cliente *out){
-    bool ok=false; omp_set_lock(&q->lock);
-    if(q->size>0){ *out=q->buf[q->head]; q->head=(q->head+1)%q->cap; q->size--; ok=true; }
-    omp_unset_lock(&q->lock); return ok;
+// Foto al final de un tick
+static inline void serie_registrar(Metricas *m, int it, const Config *cfg, Cola *q_caja, Cola *q_hot, Cola *q_cold,
+                                   const Servidor *cajas, const Servidor *hot, const Servidor *cold){
+    double v[SER_COLS];
+    serie_foto(v, cfg, q_caja, q_hot, q_cold, cajas, hot, cold);
+    serie_sumar(m, it, it+1, v);
 }
 
 // =======================
 // PROTOTIPOS 
 // =======================
-static void seccion_cajas(double t, RNG *rng, Cola *q_caja, Cola *q_hot, Cola *q_cold,
-                          Servidor *cajas, int n_caja, double *espera_local);
-static void seccion_barra_caliente(double t, RNG *rng, Cola *q_hot, Servidor *hot, int n_hot,
-                                   double *ventas_local, int *compl_local, double *espera_local);
-static void seccion_barra_fria(double t, RNG *rng, Cola *q_cold, Servidor *cold, int n_cold,
-                               double *ventas_local, int *compl_local, double *espera_local);
+static Cliente nuevo_cliente(int it, double t, double paciencia, RNG *flujos[EST_COUNT], Llegadas *lleg);
+static void seccion_llegadas(int it, double t, const Config *cfg, Llegadas *lleg, RNG *flujos[EST_COUNT], Cola *q_caja,
+                             Resultado *acc);
+static void seccion_abandono(const Config *cfg, double t, Cola *q_caja, Cola *q_hot, Cola *q_cold, Resultado *acc);
+static void seccion_cajas(int it, int tick_limite, double t, Cola *q_caja, Cola *q_hot, Cola *q_cold,
+                          Servidor *cajas, int n_caja, Resultado *acc, Histo *hist);
+static void seccion_barra(int tick_limite, double t, Cola *q, Servidor *srv, int n,
+                          const double *mu_tipo, Resultado *acc, Histo *hist);
 
 // =======================
 // IMPLEMENTACIONES
 // =======================
-static void seccion_cajas(double t, RNG *rng, Cola *q_caja, Cola *q_hot, Cola *q_cold,
-                          Servidor *cajas, int n_caja, double *espera_local)
+// El cliente trae sorteado al llegar todo lo que va a pedir: tipo de bebida,
+// paciencia y trabajo unitario en caja y barra, cada uno de su propio flujo.
+// Así el cliente i-ésimo de una réplica es el mismo en cualquier configuración
+// de personal (números aleatorios comunes) y las estaciones ya no consumen
+// aleatorios. La paciencia se sortea aunque sea infinita para no correr el flujo.
+static Cliente nuevo_cliente(int it, double t, double paciencia, RNG *flujos[EST_COUNT], Llegadas *lleg)
+{
+    Cliente c; c.t_llegada=t; c.t_fin_caja=0.0; c.tick=it; c.replica=lleg->replica; c.id=lleg->n++;
+    c.tipo    = alias_sample(&ALIAS_MEZCLA, flujos[EST_LLEGADAS]);
+    double w_pac = expo_zig(flujos[EST_LLEGADAS]);
+    c.paciencia = (paciencia > 0.0)? w_pac*paciencia : INFINITY;
+    c.w_caja  = expo_zig(flujos[EST_CAJA]);
+    c.w_barra = expo_zig(flujos[es_fria(c.tipo)? EST_COLD : EST_HOT]);
+    traza_evento(&c, TR_LLEGADA, t);
+    return c;
+}
+
+// Entran todos los que llegan durante el tick; el sorteo del cliente va antes
+// que el de la siguiente llegada, igual que en el motor de eventos.
+static void seccion_llegadas(int it, double t, const Config *cfg, Llegadas *lleg, RNG *flujos[EST_COUNT], Cola *q_caja,
+                             Resultado *acc)
 {
-    double espera_add = 0.0;
+    while(lleg->prox < t + DT){
+        Cliente c = nuevo_cliente(it, t, cfg->paciencia, flujos, lleg);
+        cola_enqueue(q_caja, c, t + c.paciencia);
+        acc->llegadas++;
+        llegadas_avanzar(lleg, flujos[EST_LLEGADAS]);
+    }
+}
 
+// Abandono hasta el instante t: se van los que agotaron su paciencia (de
+// cualquier punto de la cola) y, si aún queda una cola más larga que el
+// umbral, los sobrantes (ver cb_recortar).
+static void seccion_abandono(const Config *cfg, double t, Cola *q_caja, Cola *q_hot, Cola *q_cold, Resultado *acc)
+{
+    Cola *qs[3] = { q_caja, q_hot, q_cold };
+    for(int k=0;k<3;k++) acc->aband += cola_vencer(qs[k], t) + cola_recortar(qs[k], cfg->umbral, cfg->paciencia > 0.0);
+}
+
+static void seccion_cajas(int it, int tick_limite, double t, Cola *q_caja, Cola *q_hot, Cola *q_cold,
+                          Servidor *cajas, int n_caja, Resultado *acc, Histo *hist)
+{
     for(int i=0; i<n_caja; ++i){
         // Avanzar servicio si ocupado
         if(cajas[i].ocupado){
@@ -137,9 +1122,9 @@ static void seccion_cajas(double t, RNG *rng, Cola *q_caja, Cola *q_hot, Cola *q
             if(cajas[i].t_restante <= 0.0){
                 // Pasa a barra correspondiente
                 Cliente c = cajas[i].c;
-                c.t_fin_caja = t;
-                if(es_fria(c.tipo)) (void)cola_enqueue(q_cold, c);
-                else                (void)cola_enqueue(q_hot,  c);
+                c.t_fin_caja = t; c.tick = it;
+                traza_evento(&c, TR_FIN_CAJA, t);
+                cola_enqueue(es_fria(c.tipo)? q_cold : q_hot, c, t + c.paciencia);
 
                 cajas[i].ocupado = false;
                 cajas[i].t_restante = 0.0;
@@ -149,183 +1134,1627 @@ static void seccion_cajas(double t, RNG *rng, Cola *q_caja, Cola *q_hot, Cola *q
         // Si está libre, tomar de la cola de caja
         if(!cajas[i].ocupado){
             Cliente c;
-            if(cola_dequeue(q_caja, &c)){
-                espera_add += (t - c.t_llegada);
+            if(cola_dequeue_listo(q_caja, tick_limite, &c)){
+                acc->espera += (t - c.t_llegada);
+                if(hist) histo_add(hist, t - c.t_llegada);
+                traza_evento(&c, TR_INICIO_CAJA, t);
                 cajas[i].c = c;
-                cajas[i].t_restante = expo(MU_CAJA, rng);
+                cajas[i].t_restante = c.w_caja / MU_CAJA;
                 cajas[i].ocupado = true;
             }
         }
     }
-
-    // Acumular la espera de esta sección de forma segura
-    #pragma omp critical(accum_espera)
-    {
-        *espera_local += espera_add;
-    }
 }
 
-static void seccion_barra_caliente(double t, RNG *rng, Cola *q_hot, Servidor *hot, int n_hot,
-                                   double *ventas_local, int *compl_local, double *espera_local)
+// Barra caliente o fría: misma lógica, cambia la tabla de velocidades por tipo
+static void seccion_barra(int tick_limite, double t, Cola *q, Servidor *srv, int n,
+                          const double *mu_tipo, Resultado *acc, Histo *hist)
 {
-    double ventas_add = 0.0;
-    int    compl_add  = 0;
-    double espera_add = 0.0;
-
-    for(int j=0; j<n_hot; ++j){
+    for(int j=0; j<n; ++j){
         // Avanzar si ocupado
-        if(hot[j].ocupado){
-            hot[j].t_restante -= DT;
-            if(hot[j].t_restante <= 0.0){
-                ventas_add += PRECIOS[ hot[j].c.tipo ];
-                compl_add  += 1;
-                hot[j].ocupado = false;
-                hot[j].t_restante = 0.0;
+        if(srv[j].ocupado){
+            srv[j].t_restante -= DT;
+            if(srv[j].t_restante <= 0.0){
+                acc->ventas += PRECIOS[ srv[j].c.tipo ];
+                acc->compl  += 1;
+                traza_evento(&srv[j].c, TR_FIN_BARRA, t);
+                srv[j].ocupado = false;
+                srv[j].t_restante = 0.0;
             }
         }
 
-        // Si libre, tomar de la cola caliente
-        if(!hot[j].ocupado){
+        // Si libre, tomar de la cola de la barra
+        if(!srv[j].ocupado){
             Cliente c;
-            if(cola_dequeue(q_hot, &c)){
-                espera_add += (t - c.t_fin_caja);
-                double mu = MU_HOT[c.tipo];
+            if(cola_dequeue_listo(q, tick_limite, &c)){
+                acc->espera += (t - c.t_fin_caja);
+                if(hist) histo_add(hist, t - c.t_fin_caja);
+                traza_evento(&c, TR_INICIO_BARRA, t);
+                double mu = mu_tipo[c.tipo];
                 if(mu <= 0.0) mu = 1.0; // fallback de seguridad
-                hot[j].c = c;
-                hot[j].t_restante = expo(mu, rng);
-                hot[j].ocupado = true;
+                srv[j].c = c;
+                srv[j].t_restante = c.w_barra / mu;
+                srv[j].ocupado = true;
             }
         }
     }
+}
 
-    // Acumular de forma segura
-    #pragma omp critical(accum_hot)
-    {
-        *ventas_local += ventas_add;
-        *compl_local  += compl_add;
-        *espera_local += espera_add;
+// =======================
+// RÉPLICAS
+// =======================
+// Un flujo aleatorio por estación de la réplica, llave (r_id, estación)
+static void flujos_replica(RNG rng[EST_COUNT], int r_id){
+    for(int s=0;s<EST_COUNT;s++) rng_replica(&rng[s], r_id, (uint32_t)s);
+}
+
+// Estructura original: en cada tick se abre un equipo nuevo con 4 secciones.
+// Se conserva solo como referencia para el modo -bench.
+static void replica_secciones(const Config *cfg, int r_id, int ticks, Resultado *res, Metricas *met){
+    RNG rng[EST_COUNT]; flujos_replica(rng, r_id);
+    RNG *flujos[EST_COUNT] = { &rng[0], &rng[1], &rng[2], &rng[3] };
+    Cola q_caja, q_hot, q_cold; cola_init(&q_caja, 256); cola_init(&q_hot, 256); cola_init(&q_cold, 256);
+    Servidor cajas[MAX_SRV] = {0}; Servidor hot[MAX_SRV] = {0}; Servidor cold[MAX_SRV] = {0};
+    Resultado acc[EST_COUNT] = {0};
+    Llegadas lleg; llegadas_init(&lleg, cfg->perfil, &rng[EST_LLEGADAS], r_id);
+
+    for(int it=0; it<ticks; ){
+        double t = it*DT;
+
+        #pragma omp parallel sections
+        {
+            // 1) Llegan clientes y, si las colas están enormes, algunos se van.
+            #pragma omp section
+            { seccion_llegadas(it, t, cfg, &lleg, flujos, &q_caja, &acc[EST_LLEGADAS]); }
+
+            // 2) Cajas
+            #pragma omp section
+            { seccion_cajas(it, INT_MAX, t, &q_caja, &q_hot, &q_cold, cajas, cfg->n_caja, &acc[EST_CAJA], met? &met->h[EST_CAJA] : NULL); }
+
+            // 3) Barra caliente
+            #pragma omp section
+            { seccion_barra(INT_MAX, t, &q_hot, hot, cfg->n_hot, MU_HOT, &acc[EST_HOT], met? &met->h[EST_HOT] : NULL); }
+
+            // 4) Barra fría
+            #pragma omp section
+            { seccion_barra(INT_MAX, t, &q_cold, cold, cfg->n_cold, MU_COLD, &acc[EST_COLD], met? &met->h[EST_COLD] : NULL); }
+        }
+        seccion_abandono(cfg, t + DT, &q_caja, &q_hot, &q_cold, &acc[EST_LLEGADAS]);
+        if(met) serie_registrar(met, it, cfg, &q_caja, &q_hot, &q_cold, cajas, hot, cold);
+        it = replica_vacia(cfg, &q_caja, &q_hot, &q_cold, cajas, hot, cold)? tick_siguiente(it, ticks, lleg.prox) : it+1;
     }
+
+    *res = (Resultado){0};
+    for(int s=0;s<EST_COUNT;s++) resultado_sumar(res, &acc[s]);
+    cola_free(&q_caja); cola_free(&q_hot); cola_free(&q_cold);
 }
 
-static void seccion_barra_fria(double t, RNG *rng, Cola *q_cold, Servidor *cold, int n_cold,
-                               double *ventas_local, int *compl_local, double *espera_local)
-{
-    double ventas_add = 0.0;
-    int    compl_add  = 0;
-    double espera_add = 0.0;
+// Pipeline persistente: el equipo de la réplica se crea una sola vez y cada hilo
+// avanza sus estaciones tick a tick. Cada estación solo toma clientes que le
+// entregaron en ticks anteriores (sello c.tick), así el resultado no depende de
+// cómo se intercalen los hilos dentro de un tick. Con menos hilos que estaciones
+// (p.ej. sin paralelismo anidado) un mismo hilo corre varias estaciones.
+static void replica_pipeline(const Config *cfg, int r_id, int ticks, int hilos, Resultado *res, Metricas *met){
+    RNG rng[EST_COUNT]; flujos_replica(rng, r_id);
+    RNG *flujos[EST_COUNT] = { &rng[0], &rng[1], &rng[2], &rng[3] };
+    Cola q_caja, q_hot, q_cold; cola_init(&q_caja, 256); cola_init(&q_hot, 256); cola_init(&q_cold, 256);
+    Servidor cajas[MAX_SRV] = {0}; Servidor hot[MAX_SRV] = {0}; Servidor cold[MAX_SRV] = {0};
+    Resultado acc[EST_COUNT] = {0};
+    Llegadas lleg; llegadas_init(&lleg, cfg->perfil, &rng[EST_LLEGADAS], r_id);
+    int it_sig = 0;                     // lo fija el single del fin de tick
 
-    for(int k=0; k<n_cold; ++k){
-        // Avanzar si ocupado
-        if(cold[k].ocupado){
-            cold[k].t_restante -= DT;
-            if(cold[k].t_restante <= 0.0){
-                ventas_add += PRECIOS[ cold[k].c.tipo ];
-                compl_add  += 1;
-                cold[k].ocupado = false;
-                cold[k].t_restante = 0.0;
+    #pragma omp parallel num_threads(hilos)
+    {
+        int tid = omp_get_thread_num(), nth = omp_get_num_threads();
+
+        for(int it=0; it<ticks; it=it_sig){
+            double t = it*DT;
+
+            for(int s=tid; s<EST_COUNT; s+=nth){
+                switch(s){
+                    case EST_LLEGADAS: seccion_llegadas(it, t, cfg, &lleg, flujos, &q_caja, &acc[s]); break;
+                    case EST_CAJA:     seccion_cajas(it, it, t, &q_caja, &q_hot, &q_cold, cajas, cfg->n_caja, &acc[s], met? &met->h[s] : NULL); break;
+                    case EST_HOT:      seccion_barra(it, t, &q_hot,  hot,  cfg->n_hot,  MU_HOT,  &acc[s], met? &met->h[s] : NULL); break;
+                    case EST_COLD:     seccion_barra(it, t, &q_cold, cold, cfg->n_cold, MU_COLD, &acc[s], met? &met->h[s] : NULL); break;
+                }
+            }
+
+            // Fin de tick: colas quietas, se aplica el abandono y se elige el
+            // siguiente tick (saltando los vacíos hasta la próxima llegada)
+            #pragma omp barrier
+            #pragma omp single
+            {
+                seccion_abandono(cfg, t + DT, &q_caja, &q_hot, &q_cold, &acc[EST_LLEGADAS]);
+                if(met) serie_registrar(met, it, cfg, &q_caja, &q_hot, &q_cold, cajas, hot, cold);
+                it_sig = replica_vacia(cfg, &q_caja, &q_hot, &q_cold, cajas, hot, cold)? tick_siguiente(it, ticks, lleg.prox) : it+1;
             }
         }
+    }
 
-        // Si libre, tomar de la cola fría
-        if(!cold[k].ocupado){
-            Cliente c;
-            if(cola_dequeue(q_cold, &c)){
-                espera_add += (t - c.t_fin_caja);
-                double mu = MU_COLD[c.tipo];
-                if(mu <= 0.0) mu = 1.0; // fallback
-                cold[k].c = c;
-                cold[k].t_restante = expo(mu, rng);
-                cold[k].ocupado = true;
+    *res = (Resultado){0};
+    for(int s=0;s<EST_COUNT;s++) resultado_sumar(res, &acc[s]);
+    cola_free(&q_caja); cola_free(&q_hot); cola_free(&q_cold);
+}
+
+// =======================
+// MOTOR DE EVENTOS DISCRETOS
+// =======================
+// En lugar de avanzar en pasos de DT, se salta de evento en evento: una llegada
+// o el fin de un servicio. Los tiempos de servicio se conocen al despachar, así
+// que no hay que descontar t_restante en cada tick y las esperas son exactas.
+enum TipoEvento { EV_LLEGADA=0, EV_FIN_CAJA, EV_FIN_HOT, EV_FIN_COLD };
+
+typedef struct {
+    double   t;       // instante del evento (min)
+    uint64_t seq;     // desempate estable para eventos simultáneos
+    int      tipo;    // TipoEvento
+    int      srv;     // índice del servidor (eventos de fin)
+} Evento;
+
+// Montículo binario de mínimos por (t, seq)
+typedef struct { Evento *v; int size, cap; uint64_t seq; } Heap;
+static void heap_init(Heap *h, int cap){ h->v=(Evento*)malloc(sizeof(Evento)*cap); h->size=0; h->cap=cap; h->seq=0; }
+static void heap_free(Heap *h){ free(h->v); }
+static inline bool ev_menor(const Evento *a, const Evento *b){ return a->t<b->t || (a->t==b->t && a->seq<b->seq); }
+static void heap_push(Heap *h, double t, int tipo, int srv){
+    if(h->size==h->cap){ h->cap*=2; h->v=(Evento*)realloc(h->v, sizeof(Evento)*h->cap); }
+    Evento e = { t, h->seq++, tipo, srv };
+    int i=h->size++;
+    while(i>0){ int p=(i-1)/2; if(!ev_menor(&e,&h->v[p])) break; h->v[i]=h->v[p]; i=p; }
+    h->v[i]=e;
+}
+static Evento heap_pop(Heap *h){
+    Evento top=h->v[0], e=h->v[--h->size];
+    int i=0;
+    for(;;){
+        int l=2*i+1, m=l+1, c=l;
+        if(l>=h->size) break;
+        if(m<h->size && ev_menor(&h->v[m],&h->v[l])) c=m;
+        if(!ev_menor(&h->v[c],&e)) break;
+        h->v[i]=h->v[c]; i=c;
+    }
+    if(h->size>0) h->v[i]=e;
+    return top;
+}
+
+// Intenta despachar al primer cliente de la cola a un servidor libre
+static void ev_despachar(double t, int tipo_fin, Cola *q, Servidor *srv, int n, const double *mu_tipo,
+                         Heap *h, Resultado *acc, Histo *hist){
+    for(int i=0;i<n && !cola_empty(q);i++){
+        if(srv[i].ocupado) continue;
+        Cliente c; cola_dequeue(q, &c);
+        double dur;
+        double espera = (tipo_fin==EV_FIN_CAJA)? t - c.t_llegada : t - c.t_fin_caja;
+        acc->espera += espera;
+        if(hist) histo_add(hist, espera);
+        traza_evento(&c, (tipo_fin==EV_FIN_CAJA)? TR_INICIO_CAJA : TR_INICIO_BARRA, t);
+        if(tipo_fin==EV_FIN_CAJA) dur = c.w_caja / MU_CAJA;
+        else { double mu = mu_tipo[c.tipo]; if(mu<=0.0) mu=1.0; dur = c.w_barra / mu; }
+        srv[i].c = c; srv[i].ocupado = true;
+        heap_push(h, t + dur, tipo_fin, i);
+    }
+}
+
+static void replica_eventos(const Config *cfg, int r_id, int ticks, Resultado *res, Metricas *met){
+    RNG rng[EST_COUNT]; flujos_replica(rng, r_id);
+    RNG *flujos[EST_COUNT] = { &rng[0], &rng[1], &rng[2], &rng[3] };
+    const double T_FIN = cfg->horizonte;
+    Cola q_caja, q_hot, q_cold; cola_init(&q_caja, 256); cola_init(&q_hot, 256); cola_init(&q_cold, 256);
+    Servidor cajas[MAX_SRV] = {0}; Servidor hot[MAX_SRV] = {0}; Servidor cold[MAX_SRV] = {0};
+    Resultado acc = {0};
+    Heap h; heap_init(&h, 1 + cfg->n_caja + cfg->n_hot + cfg->n_cold);
+
+    Llegadas lleg; llegadas_init(&lleg, cfg->perfil, &rng[EST_LLEGADAS], r_id);
+    if(lleg.prox < T_FIN) heap_push(&h, lleg.prox, EV_LLEGADA, 0);
+
+    int it_reg = 0;                     // próximo tick a fotografiar para la serie
+    while(h.size>0){
+        Evento e = heap_pop(&h);
+        if(e.t >= T_FIN) break;
+        double t = e.t;
+        // Los que agotaron su paciencia antes de este evento ya no están
+        seccion_abandono(cfg, t, &q_caja, &q_hot, &q_cold, &acc);
+        // El estado es constante entre eventos: una sola foto para los ticks que ya pasaron
+        if(met && it_reg<ticks && (it_reg+1)*DT<=t){
+            int it_fin = (int)(t/DT);
+            double v[SER_COLS];
+            serie_foto(v, cfg, &q_caja, &q_hot, &q_cold, cajas, hot, cold);
+            serie_sumar(met, it_reg, it_fin, v);
+            it_reg = it_fin;
+        }
+
+        switch(e.tipo){
+            case EV_LLEGADA: {
+                Cliente c = nuevo_cliente(0, t, cfg->paciencia, flujos, &lleg);
+                cola_enqueue(&q_caja, c, t + c.paciencia);
+                acc.llegadas++;
+                acc.aband += cola_recortar(&q_caja, cfg->umbral, cfg->paciencia > 0.0);
+                llegadas_avanzar(&lleg, &rng[EST_LLEGADAS]);
+                if(lleg.prox < T_FIN) heap_push(&h, lleg.prox, EV_LLEGADA, 0);
+                break;
+            }
+            case EV_FIN_CAJA: {
+                Cliente c = cajas[e.srv].c; c.t_fin_caja = t;
+                traza_evento(&c, TR_FIN_CAJA, t);
+                cajas[e.srv].ocupado = false;
+                Cola *qb = es_fria(c.tipo)? &q_cold : &q_hot;
+                cola_enqueue(qb, c, t + c.paciencia);
+                acc.aband += cola_recortar(qb, cfg->umbral, cfg->paciencia > 0.0);
+                if(es_fria(c.tipo)) ev_despachar(t, EV_FIN_COLD, &q_cold, cold, cfg->n_cold, MU_COLD, &h, &acc, met? &met->h[EST_COLD] : NULL);
+                else                ev_despachar(t, EV_FIN_HOT,  &q_hot,  hot,  cfg->n_hot,  MU_HOT,  &h, &acc, met? &met->h[EST_HOT] : NULL);
+                break;
+            }
+            case EV_FIN_HOT:
+            case EV_FIN_COLD: {
+                Servidor *srv = (e.tipo==EV_FIN_HOT)? hot : cold;
+                acc.ventas += PRECIOS[ srv[e.srv].c.tipo ];
+                acc.compl  += 1;
+                traza_evento(&srv[e.srv].c, TR_FIN_BARRA, t);
+                srv[e.srv].ocupado = false;
+                if(e.tipo==EV_FIN_HOT) ev_despachar(t, EV_FIN_HOT,  &q_hot,  hot,  cfg->n_hot,  MU_HOT,  &h, &acc, met? &met->h[EST_HOT] : NULL);
+                else                   ev_despachar(t, EV_FIN_COLD, &q_cold, cold, cfg->n_cold, MU_COLD, &h, &acc, met? &met->h[EST_COLD] : NULL);
+                break;
             }
         }
+        // La caja puede tomar a alguien tras una llegada o al quedar libre
+        if(e.tipo==EV_LLEGADA || e.tipo==EV_FIN_CAJA)
+            ev_despachar(t, EV_FIN_CAJA, &q_caja, cajas, cfg->n_caja, NULL, &h, &acc, met? &met->h[EST_CAJA] : NULL);
     }
 
-    // Acumular de forma segura
-    #pragma omp critical(accum_cold)
-    {
-        *ventas_local += ventas_add;
-        *compl_local  += compl_add;
-        *espera_local += espera_add;
+    if(met && it_reg<ticks){
+        double v[SER_COLS];
+        serie_foto(v, cfg, &q_caja, &q_hot, &q_cold, cajas, hot, cold);
+        serie_sumar(met, it_reg, ticks, v);
     }
+    *res = acc;
+    heap_free(&h);
+    cola_free(&q_caja); cola_free(&q_hot); cola_free(&q_cold);
 }
 
 // =======================
-// PROGRAMA PRINCIPAL
+// RÉPLICAS EN LOCKSTEP (SIMD)
 // =======================
-int main(void){
-    const int TICKS = (int)floor(T_MIN/DT + 0.5);
+// Una réplica es muy poco trabajo por tick (unos cuantos servidores y tres
+// colas), así que aquí SIMD_LANES réplicas avanzan juntas en una sola función:
+// el estado de los servidores va en arreglos SoA [servidor][carril] y las
+// partes uniformes del tick (descuento de t_restante y máscara de fin de
+// servicio) se hacen en lazos omp simd sobre los carriles. Lo que depende de
+// cada cliente (llegadas, colas, despacho) se hace por carril en lote.
+// Las reglas y el orden de sorteos son los del pipeline, así que cada carril
+// da exactamente el mismo resultado que replica_pipeline con la misma r_id.
+// Los sorteos también van por carriles: al empezar el tick, las ventanas
+// agotadas de todos los carriles se recalculan en un solo lazo simd de Philox
+// (el sorteo es función pura del contador, así que no cambia ningún valor).
+// Los carriles >= nrep de un lote incompleto quedan sin llegadas: solo
+// ocupan posiciones inactivas en los lazos simd.
+#define SIMD_LANES 8
 
-    // Preparar las tasas de llegada por minuto (con pico a mitad de la jornada)
-    double *lambda = (double*)malloc(sizeof(double)*TICKS);
-    llenar_lambda(lambda, TICKS);
+// Carga la ventana siguiente de cada carril l<nl que ya agotó la suya: los
+// RNG_VENTANA/2 bloques de todos esos carriles van en un lazo simd
+static void rng_cargar_carriles(RNG *r, int nl){
+    enum { B = RNG_VENTANA/2 };
+    int idx[SIMD_LANES], m=0;
+    for(int l=0;l<nl;l++) if(r[l].n / RNG_VENTANA != r[l].ven) idx[m++] = l;
+    if(m==0) return;
+    uint32_t w0[SIMD_LANES*B], w1[SIMD_LANES*B], w2[SIMD_LANES*B], w3[SIMD_LANES*B];
+    uint32_t l0[SIMD_LANES*B], l1[SIMD_LANES*B];
+    for(int i=0;i<m;i++){
+        const RNG *x = &r[idx[i]];
+        for(int j=0;j<B;j++){
+            uint64_t b = (x->n / RNG_VENTANA)*B + j;
+            w0[i*B+j] = (uint32_t)b; w1[i*B+j] = (uint32_t)(b>>32); l0[i*B+j] = x->k0; l1[i*B+j] = x->k1;
+        }
+    }
+    #pragma omp simd
+    for(int q=0;q<m*B;q++){
+        uint32_t c0=w0[q], c1=w1[q], c2=0, c3=0, k0=l0[q], k1=l1[q];
+        PHILOX10(c0,c1,c2,c3,k0,k1)
+        w0[q]=c0; w1[q]=c1; w2[q]=c2; w3[q]=c3;
+    }
+    for(int i=0;i<m;i++){
+        RNG *x = &r[idx[i]];
+        for(int j=0;j<B;j++){
+            int q = i*B+j;
+            x->buf[2*j] = ((uint64_t)w1[q]<<32) | w0[q]; x->buf[2*j+1] = ((uint64_t)w3[q]<<32) | w2[q];
+        }
+        x->ven = x->n / RNG_VENTANA;
+    }
+}
 
-    // Variables globales con reducción
-    double ventas_tot=0.0, espera_tot=0.0; int compl_tot=0, aband_tot=0;
+typedef ColaBase ColaCarril;      // sin candado: un solo hilo por carril
 
-    // --- Paralelismo por réplicas: cada hilo corre una simulación completa ---
-    #pragma omp parallel for default(none) schedule(static) \
-        shared(lambda) reduction(+:ventas_tot,espera_tot,compl_tot,aband_tot)
-    for(int r_id=0; r_id<R; ++r_id){
-        // Estado privado de la réplica
-        RNG rng; rng_seed(&rng, 1234567ull + 7919ull*r_id);
-        Cola q_caja, q_hot, q_cold; cola_init(&q_caja, 4096); cola_init(&q_hot, 4096); cola_init(&q_cold, 4096);
-        Servidor cajas[N_CAJA] = {0}; Servidor hot[N_HOT] = {0}; Servidor cold[N_COLD] = {0};
-        double ventas_local=0.0, espera_local=0.0; int compl_local=0, aband_local=0;
-
-        // Tiempo avanza en pasos de DT. En cada paso corren 4 secciones en paralelo.
-        for(int it=0; it<TICKS; ++it){
-            double t = it*DT;
+typedef struct {
+    double t_rest[MAX_SRV][SIMD_LANES];
+    int    ocup[MAX_SRV][SIMD_LANES];
+    Cliente c[MAX_SRV][SIMD_LANES];
+} ServidoresSoA;
 
-            #pragma omp parallel sections
-            {
-                // 1) Llegan clientes y, si las colas están enormes, algunos se van.
-                #pragma omp section
-                {
-                    int k = poisson_knuth(lambda[it]*DT, &rng);
-                    for(int j=0;j<k;j++){
-                        Cliente c; c.t_llegada=t; c.t_fin_caja=0.0; c.tipo = categorical(MEZCLA, TIPO_COUNT, &rng);
-                        cola_enqueue(&q_caja, c);
+// Descuento vectorizado del servicio; fin[s][l]=1 donde el servicio terminó
+static inline void soa_descontar(ServidoresSoA *sv, int n, int fin[MAX_SRV][SIMD_LANES]){
+    for(int s=0;s<n;s++){
+        #pragma omp simd
+        for(int l=0;l<SIMD_LANES;l++){
+            double tr = sv->t_rest[s][l] - (sv->ocup[s][l]? DT : 0.0);
+            int f = sv->ocup[s][l] && tr<=0.0;
+            sv->t_rest[s][l] = f? 0.0 : tr;
+            sv->ocup[s][l]   = sv->ocup[s][l] && !f;
+            fin[s][l] = f;
+        }
+    }
+}
+
+static void replica_lote_simd(const Config *cfg, int r0, int nrep, int ticks, Resultado *res, Metricas *met){
+    RNG rng[EST_COUNT][SIMD_LANES];
+    for(int l=0;l<SIMD_LANES;l++)
+        for(int s=0;s<EST_COUNT;s++) rng_replica(&rng[s][l], r0+l, (uint32_t)s);
+
+    ColaCarril *q = (ColaCarril*)malloc(3*SIMD_LANES*sizeof(ColaCarril));   // [caja|hot|cold][carril]
+    for(int i=0;i<3*SIMD_LANES;i++) cb_init(&q[i], 256);
+    ColaCarril *q_caja=q, *q_hot=q+SIMD_LANES, *q_cold=q+2*SIMD_LANES;
+    ServidoresSoA *sv = (ServidoresSoA*)calloc(3, sizeof(ServidoresSoA));     // caja, hot, cold
+    Resultado acc[EST_COUNT][SIMD_LANES]; memset(acc, 0, sizeof(acc));
+    int fin[MAX_SRV][SIMD_LANES];
+    const int nsrv[3] = { cfg->n_caja, cfg->n_hot, cfg->n_cold };
+    const int nl = (nrep < SIMD_LANES)? nrep : SIMD_LANES;   // carriles útiles
+    Llegadas lleg[SIMD_LANES];
+    for(int l=0;l<nl;l++) llegadas_init(&lleg[l], cfg->perfil, &rng[EST_LLEGADAS][l], r0+l);
+
+    for(int it=0; it<ticks; ){
+        double t = it*DT;
+
+        // 1) Llegadas del tick, carril por carril (mismo orden de sorteos que el pipeline)
+        for(int s=0;s<EST_COUNT;s++) rng_cargar_carriles(rng[s], nl);
+        for(int l=0;l<nl;l++){
+            RNG *flujos[EST_COUNT] = { &rng[0][l], &rng[1][l], &rng[2][l], &rng[3][l] };
+            while(lleg[l].prox < t + DT){
+                Cliente c=nuevo_cliente(it, t, cfg->paciencia, flujos, &lleg[l]); cb_push(&q_caja[l], &c, t + c.paciencia);
+                acc[EST_LLEGADAS][l].llegadas++;
+                llegadas_avanzar(&lleg[l], &rng[EST_LLEGADAS][l]);
+            }
+        }
+
+        // 2) Cajas: descuento vectorizado, luego entregas y despacho por carril
+        soa_descontar(&sv[0], nsrv[0], fin);
+        for(int l=0;l<nl;l++){
+            for(int i=0;i<nsrv[0];i++){
+                if(fin[i][l]){
+                    Cliente c = sv[0].c[i][l]; c.t_fin_caja = t; c.tick = it;
+                    traza_evento(&c, TR_FIN_CAJA, t);
+                    cb_push(es_fria(c.tipo)? &q_cold[l] : &q_hot[l], &c, t + c.paciencia);
+                }
+                Cliente c;
+                if(!sv[0].ocup[i][l] && cb_pop_listo(&q_caja[l], it, &c)){
+                    acc[EST_CAJA][l].espera += (t - c.t_llegada);
+                    if(met) histo_add(&met->h[EST_CAJA], t - c.t_llegada);
+                    traza_evento(&c, TR_INICIO_CAJA, t);
+                    sv[0].c[i][l] = c; sv[0].t_rest[i][l] = c.w_caja / MU_CAJA; sv[0].ocup[i][l] = 1;
+                }
+            }
+        }
+
+        // 3) y 4) Barras caliente y fría
+        for(int b=1;b<=2;b++){
+            ColaCarril *qb = (b==1)? q_hot : q_cold;
+            const double *mu_tipo = (b==1)? MU_HOT : MU_COLD;
+            const int est = (b==1)? EST_HOT : EST_COLD;
+            Resultado *ab = acc[est];
+            soa_descontar(&sv[b], nsrv[b], fin);
+            for(int l=0;l<nl;l++){
+                for(int j=0;j<nsrv[b];j++){
+                    if(fin[j][l]){ ab[l].ventas += PRECIOS[ sv[b].c[j][l].tipo ]; ab[l].compl += 1; traza_evento(&sv[b].c[j][l], TR_FIN_BARRA, t); }
+                    Cliente c;
+                    if(!sv[b].ocup[j][l] && cb_pop_listo(&qb[l], it, &c)){
+                        ab[l].espera += (t - c.t_fin_caja);
+                        if(met) histo_add(&met->h[est], t - c.t_fin_caja);
+                        traza_evento(&c, TR_INICIO_BARRA, t);
+                        double mu = mu_tipo[c.tipo];
+                        if(mu <= 0.0) mu = 1.0;
+                        sv[b].c[j][l] = c; sv[b].t_rest[j][l] = c.w_barra / mu; sv[b].ocup[j][l] = 1;
                     }
-                    // Regla sencilla de abandono por cola muy larga
-                    while(cola_len(&q_caja) > UMBRAL_LEN){ Cliente dummy; cola_dequeue(&q_caja,&dummy); aband_local++; }
-                    while(cola_len(&q_hot)  > UMBRAL_LEN){ Cliente dummy; cola_dequeue(&q_hot, &dummy); aband_local++; }
-                    while(cola_len(&q_cold) > UMBRAL_LEN){ Cliente dummy; cola_dequeue(&q_cold,&dummy); aband_local++; }
                 }
+            }
+        }
+
+        // Fin de tick: paciencia agotada y colas sobre el umbral, por carril
+        for(int l=0;l<nl;l++){
+            ColaCarril *qs[3] = { &q_caja[l], &q_hot[l], &q_cold[l] };
+            for(int k=0;k<3;k++) acc[EST_LLEGADAS][l].aband += cb_vencer(qs[k], t + DT) + cb_recortar(qs[k], cfg->umbral, cfg->paciencia > 0.0);
+        }
+
+        if(met){
+            double *f = &met->serie[(size_t)(it/met->paso)*SER_COLS];
+            for(int l=0;l<nl;l++){
+                f[SER_COLA_CAJA] += q_caja[l].size; f[SER_COLA_HOT] += q_hot[l].size; f[SER_COLA_COLD] += q_cold[l].size;
+                for(int b=0;b<3;b++){
+                    int k=0; for(int i=0;i<nsrv[b];i++) k += sv[b].ocup[i][l];
+                    f[SER_UTIL_CAJA+b] += (double)k/nsrv[b];
+                }
+            }
+        }
+
+        // Si todos los carriles útiles quedaron vacíos se salta a la primera llegada
+        bool vacio = true; double prox = INFINITY;
+        for(int l=0;l<nl && vacio;l++){
+            vacio = !q_caja[l].size && !q_hot[l].size && !q_cold[l].size;
+            for(int b=0;b<3 && vacio;b++)
+                for(int i=0;i<nsrv[b];i++) if(sv[b].ocup[i][l]){ vacio=false; break; }
+            if(lleg[l].prox < prox) prox = lleg[l].prox;
+        }
+        it = vacio? tick_siguiente(it, ticks, prox) : it+1;
+    }
+
+    for(int l=0;l<nl;l++){
+        res[l] = (Resultado){0};
+        for(int s=0;s<EST_COUNT;s++) resultado_sumar(&res[l], &acc[s][l]);
+    }
+    for(int i=0;i<3*SIMD_LANES;i++) cb_free(&q[i]);
+    free(sv); free(q);
+}
+
+// Motores de simulación disponibles
+enum Motor { MOTOR_PIPELINE=0, MOTOR_SECCIONES, MOTOR_EVENTOS, MOTOR_SIMD, MOTOR_COUNT };
+static const char *NOMBRES_MOTOR[MOTOR_COUNT] = { "pipeline", "secciones", "eventos", "simd" };
+
+// Unidad de trabajo de los lazos paralelos: una réplica, o un lote de carriles en SIMD
+static inline int replicas_por_unidad(int motor){ return (motor==MOTOR_SIMD)? SIMD_LANES : 1; }
+
+// Corre las réplicas r0..r0+n-1 (n <= replicas_por_unidad) y deja sus resultados en res
+static void correr_unidad(int motor, const Config *cfg, int r0, int n, int ticks, int hilos_est, Resultado *res, Metricas *met){
+    switch(motor){
+        case MOTOR_SECCIONES: replica_secciones(cfg, r0, ticks, res, met); break;
+        case MOTOR_EVENTOS:   replica_eventos(cfg, r0, ticks, res, met); break;
+        case MOTOR_SIMD:      replica_lote_simd(cfg, r0, n, ticks, res, met); break;
+        default:              replica_pipeline(cfg, r0, ticks, hilos_est, res, met); break;
+    }
+}
+
+// =======================
+// PLANIFICADOR CON ROBO DE TRABAJO
+// =======================
+// Las tareas (una unidad de réplicas, o una pareja configuración×unidad en el
+// barrido) se numeran 0..n-1 y cada trabajador arranca con un bloque contiguo
+// como en schedule(static). Su deque es el rango [ini, fin): el dueño toma del
+// frente y, al quedarse sin nada, roba la mitad final del trabajador con más
+// pendientes. Como los rangos son disjuntos no hay que copiar tareas, y un
+// candado por trabajador basta. Cada tarea escribe su resultado en su propia
+// casilla, así que quién la corrió no cambia lo que se suma después.
+// ini/fin se escriben bajo el candado pero siempre con atomic write, porque los
+// ladrones los leen sin candado al elegir víctima. Las deques y los acumulados
+// son de cada llamada (se suman a ESTAD_TRAB al final), así que robo_correr se
+// puede llamar anidado o desde varios hilos a la vez.
+#define MAX_TRAB 256
+
+typedef struct {
+    omp_lock_t lock;
+    int  ini, fin;              // tareas pendientes de este trabajador
+    char pad[64];               // evita compartir línea de caché entre vecinos
+} Deque;
+
+// Acumulados por trabajador a lo largo de todo el programa (para -trabajadores)
+typedef struct { double ocupado; long tareas, robos, robadas; } EstadTrabajador;
+static EstadTrabajador ESTAD_TRAB[MAX_TRAB];
+static int N_TRAB = 0;          // máximo de trabajadores usados
+
+typedef void (*FnTarea)(int tarea, void *ctx, Metricas *met);
+
+// Escritura de ini/fin (siempre con el candado tomado)
+static inline void deque_fijar(int *campo, int v){
+    #pragma omp atomic write
+    *campo = v;
+}
+
+static bool deque_tomar(Deque *d, int *tarea){
+    bool ok=false; omp_set_lock(&d->lock);
+    int i = d->ini;
+    if(i < d->fin){ *tarea = i; deque_fijar(&d->ini, i+1); ok=true; }
+    omp_unset_lock(&d->lock); return ok;
+}
+
+// Corre las tareas 0..n-1 con f. met_hilos (opcional) trae un juego de
+// métricas por hilo del equipo.
+static void robo_correr(int n, FnTarea f, void *ctx, Metricas *met_hilos){
+    int nth = omp_get_max_threads(); if(nth > MAX_TRAB) nth = MAX_TRAB;
+    Deque *dq = (Deque*)malloc(sizeof(Deque)*nth);
+    if(!dq){                                    // sin deques: todo en este hilo
+        for(int t=0;t<n;t++) f(t, ctx, met_hilos? &met_hilos[0] : NULL);
+        return;
+    }
+
+    #pragma omp parallel num_threads(nth)
+    {
+        int id = omp_get_thread_num(), nt = omp_get_num_threads();
+        Deque *yo = &dq[id];
+        EstadTrabajador e = { 0.0, 0, 0, 0 };
+        Metricas *met = met_hilos? &met_hilos[id] : NULL;
+        omp_init_lock(&yo->lock);
+        yo->ini = (int)((long)n*id/nt); yo->fin = (int)((long)n*(id+1)/nt);
+        #pragma omp barrier
+        // (todos los candados listos antes de robar)
+
+        for(;;){
+            int tarea;
+            if(!deque_tomar(yo, &tarea)){
+                // Víctima: la de más pendientes según una lectura sin candado.
+                // Con 1 pendiente no hay mitad que robar, y como las tareas solo
+                // pasan de una deque a otra, si ninguna tiene más de 1 ya no
+                // habrá robo posible: el ladrón termina en vez de girar.
+                int v=-1, mejor=1;
+                for(int k=1;k<nt;k++){
+                    int w=(id+k)%nt, a, b;
+                    #pragma omp atomic read
+                    a = dq[w].ini;
+                    #pragma omp atomic read
+                    b = dq[w].fin;
+                    if(b - a > mejor){ mejor=b-a; v=w; }
+                }
+                if(v<0) break;                  // nadie tiene pendientes: terminamos
+                omp_set_lock(&dq[v].lock);
+                int pend = dq[v].fin - dq[v].ini, k = pend - pend/2;
+                int a = dq[v].fin - k, b = dq[v].fin;
+                if(pend>1) deque_fijar(&dq[v].fin, a); else k = 0;
+                omp_unset_lock(&dq[v].lock);
+                if(k==0) continue;              // se vació mientras tanto; elegir otra
+                omp_set_lock(&yo->lock); deque_fijar(&yo->fin, b); deque_fijar(&yo->ini, a); omp_unset_lock(&yo->lock);
+                e.robos++; e.robadas += k;
+                continue;
+            }
+            double t0 = omp_get_wtime();
+            f(tarea, ctx, met);
+            e.ocupado += omp_get_wtime() - t0;
+            e.tareas++;
+        }
+
+        #pragma omp barrier
+        omp_destroy_lock(&yo->lock);
+        #pragma omp critical(estad_trab)
+        {
+            ESTAD_TRAB[id].ocupado += e.ocupado; ESTAD_TRAB[id].tareas += e.tareas;
+            ESTAD_TRAB[id].robos += e.robos;     ESTAD_TRAB[id].robadas += e.robadas;
+            if(nt > N_TRAB) N_TRAB = nt;
+        }
+    }
+    free(dq);
+}
+
+// Tiempo ocupado, tareas y robos por trabajador, acumulados en todo el programa
+static void reportar_trabajadores(void){
+    double tot=0.0, mx=0.0;
+    for(int i=0;i<N_TRAB;i++){ tot += ESTAD_TRAB[i].ocupado; if(ESTAD_TRAB[i].ocupado>mx) mx=ESTAD_TRAB[i].ocupado; }
+    printf("trabajadores=%d  desbalance(max/prom)=%.3f\n", N_TRAB, (tot>0.0)? mx*N_TRAB/tot : 0.0);
+    for(int i=0;i<N_TRAB;i++){
+        const EstadTrabajador *e = &ESTAD_TRAB[i];
+        printf("  trabajador %3d: ocupado=%.4f s  tareas=%ld  robos=%ld (%ld tareas)\n",
+               i, e->ocupado, e->tareas, e->robos, e->robadas);
+    }
+}
+
+// Tarea j de correr_rango: la unidad de réplicas r0 + j*u
+typedef struct { int motor, r0, n, ticks, hilos_est; const Config *cfg; Resultado *res; } CtxRango;
+static void tarea_rango(int j, void *p, Metricas *met){
+    const CtxRango *c = (const CtxRango*)p;
+    const int u = replicas_por_unidad(c->motor);
+    int m = (c->n - j*u < u)? c->n - j*u : u;
+    correr_unidad(c->motor, c->cfg, c->r0 + j*u, m, c->ticks, c->hilos_est, &c->res[j*u], met);
+}
+
+// Hilos por réplica que de verdad se usan. El equipo anidado del pipeline solo
+// se abre si se pidió más de 1 y externos×internos cabe en los procesadores;
+// si no, cada hilo externo corre sus cuatro estaciones sin sobresuscribir.
+static int hilos_anidados(int pedido){
+    bool anidar = pedido > 1 && omp_get_max_threads()*pedido <= omp_get_num_procs();
+    omp_set_max_active_levels(anidar? 2 : 1);
+    return anidar? pedido : 1;
+}
+
+// Corre las réplicas r0..r0+n-1 en paralelo, repartiendo unidades entre hilos.
+// met_hilos (opcional) trae un juego de métricas por hilo de este lazo.
+static void correr_rango(int motor, const Config *cfg, int r0, int n, int ticks, int hilos_est, Resultado *res,
+                         Metricas *met_hilos){
+    const int u = replicas_por_unidad(motor), nu = (n+u-1)/u;
+    CtxRango c = { motor, r0, n, ticks, hilos_anidados(hilos_est), cfg, res };
+    robo_correr(nu, tarea_rango, &c, met_hilos);
+}
+
+// Corre R réplicas en paralelo con el motor indicado y devuelve los totales.
+// Cada réplica deja su resultado en su casilla y se suman en orden de r_id:
+// una reducción de OpenMP cambiaría el redondeo según el número de hilos.
+static Resultado correr_replicas(int motor, const Config *cfg, int ticks, int hilos_est, Metricas *met_hilos){
+    Resultado res[R];
+
+    // --- Paralelismo por réplicas: cada hilo corre una simulación completa ---
+    correr_rango(motor, cfg, 0, R, ticks, hilos_est, res, met_hilos);
+
+    Resultado tot = {0};
+    for(int r_id=0; r_id<R; ++r_id) resultado_sumar(&tot, &res[r_id]);
+    return tot;
+}
+
+// =======================
+// BARRIDO DE CONFIGURACIONES
+// =======================
+// Rango "a", "a:b" o "a:b:paso" leído de la línea de comandos
+typedef struct { double a, b, paso; } Rango;
+
+static Rango rango_parse(const char *txt){
+    Rango r = { 0.0, 0.0, 1.0 };
+    int n = sscanf(txt, "%lf:%lf:%lf", &r.a, &r.b, &r.paso);
+    if(n < 2) r.b = r.a;
+    if(r.paso <= 0.0) r.paso = 1.0;
+    if(r.b < r.a) r.b = r.a;
+    return r;
+}
+static int rango_len(const Rango *r){ return (int)floor((r->b - r->a)/r->paso + 1e-9) + 1; }
+static double rango_val(const Rango *r, int k){ return r->a + k*r->paso; }
+
+static int clamp_srv(double v){ int n=(int)floor(v+0.5); return n<1? 1 : (n>MAX_SRV? MAX_SRV : n); }
 
-                // 2) Cajas
-                #pragma omp section
-                { seccion_cajas(t, &rng, &q_caja, &q_hot, &q_cold, cajas, N_CAJA, &espera_local); }
+// Resumen de una configuración del barrido
+typedef struct {
+    int    idx;                    // posición en la lista de configuraciones
+    double ventas, espera, aband;  // ventas medias por réplica, min por pedido, tasa
+    double dif_ventas, se_dif;     // diferencia pareada contra la mejor y su error estándar
+} FilaBarrido;
 
-                // 3) Barra caliente
-                #pragma omp section
-                { seccion_barra_caliente(t, &rng, &q_hot, hot, N_HOT, &ventas_local, &compl_local, &espera_local); }
+static int orden_barrido = 0;      // 0 ventas (desc), 1 espera (asc), 2 abandono (asc)
+static int cmp_fila(const void *pa, const void *pb){
+    const FilaBarrido *a=(const FilaBarrido*)pa, *b=(const FilaBarrido*)pb;
+    double ka, kb;
+    switch(orden_barrido){
+        case 1:  ka=a->espera; kb=b->espera; break;
+        case 2:  ka=a->aband;  kb=b->aband;  break;
+        default: ka=-a->ventas; kb=-b->ventas; break;
+    }
+    if(ka<kb) return -1;
+    if(ka>kb) return 1;
+    return a->idx - b->idx;
+}
+
+// Tarea k del barrido: configuración k/nu, unidad de réplicas k%nu
+typedef struct { int motor, ticks, hilos_est, nu; const Config *cfgs; Resultado *res; } CtxBarrido;
+static void tarea_barrido(int k, void *p, Metricas *met){
+    const CtxBarrido *b = (const CtxBarrido*)p;
+    const int u = replicas_por_unidad(b->motor);
+    int c = k/b->nu, j = k%b->nu, m = (R - j*u < u)? R - j*u : u;
+    (void)met;
+    correr_unidad(b->motor, &b->cfgs[c], j*u, m, b->ticks, b->hilos_est, &b->res[c*R + j*u], NULL);
+}
 
-                // 4) Barra fría
-                #pragma omp section
-                { seccion_barra_fria(t, &rng, &q_cold, cold, N_COLD, &ventas_local, &compl_local, &espera_local); }
+// Recorre el producto cartesiano de rangos. Todas las parejas configuración×réplica
+// van al planificador con robo de trabajo (las configuraciones con colas largas
+// cuestan mucho más que las holgadas); la réplica r usa los mismos flujos en
+// todas las configuraciones, así que las diferencias entre filas son de baja varianza.
+// Con perfil de archivo todas las configuraciones lo comparten y -base/-pico
+// no aplican; sin él cada una arma el perfil por defecto con su base y pico.
+static void correr_barrido(int motor, const Rango rg[6], const Perfil *archivo, double horizonte, double paciencia,
+                           int ticks, int hilos_est){
+    int len[6], ncfg=1;
+    for(int k=0;k<6;k++){ len[k]=rango_len(&rg[k]); ncfg*=len[k]; }
+
+    Config *cfgs = (Config*)malloc(sizeof(Config)*ncfg);
+    Perfil *perfiles = archivo? NULL : (Perfil*)malloc(sizeof(Perfil)*ncfg);
+    for(int c=0;c<ncfg;c++){
+        int rest=c, pos[6];
+        for(int k=5;k>=0;k--){ pos[k]=rest%len[k]; rest/=len[k]; }
+        Config *cf = &cfgs[c];
+        cf->n_caja      = clamp_srv(rango_val(&rg[0], pos[0]));
+        cf->n_hot       = clamp_srv(rango_val(&rg[1], pos[1]));
+        cf->n_cold      = clamp_srv(rango_val(&rg[2], pos[2]));
+        cf->umbral      = (int)floor(rango_val(&rg[3], pos[3]) + 0.5);
+        cf->lambda_base = rango_val(&rg[4], pos[4]);
+        cf->lambda_pico = rango_val(&rg[5], pos[5]);
+        cf->horizonte   = horizonte;
+        cf->paciencia   = paciencia;
+        if(archivo) cf->perfil = archivo;
+        else {
+            if(!perfil_pico(&perfiles[c], cf->lambda_base, cf->lambda_pico)){
+                for(int k=0;k<c;k++) perfil_liberar(&perfiles[k]);
+                free(perfiles); free(cfgs); return;
             }
+            cf->perfil = &perfiles[c];
+        }
+    }
+
+    Resultado *res = (Resultado*)malloc(sizeof(Resultado)*ncfg*R);
+    const int u = replicas_por_unidad(motor), nu = (R+u-1)/u;
+    CtxBarrido ctx = { motor, ticks, hilos_anidados(hilos_est), nu, cfgs, res };
+    double t0 = omp_get_wtime();
+    robo_correr(ncfg*nu, tarea_barrido, &ctx, NULL);
+    double seg = omp_get_wtime() - t0;
+
+    FilaBarrido *filas = (FilaBarrido*)malloc(sizeof(FilaBarrido)*ncfg);
+    for(int c=0;c<ncfg;c++){
+        Resultado tot = {0};
+        for(int r=0;r<R;r++) resultado_sumar(&tot, &res[c*R+r]);
+        filas[c].idx    = c;
+        filas[c].ventas = tot.ventas / R;
+        filas[c].espera = tot.compl? tot.espera/tot.compl : 0.0;
+        filas[c].aband  = (tot.aband+tot.compl)? (double)tot.aband/(tot.aband+tot.compl) : 0.0;
+    }
+    qsort(filas, ncfg, sizeof(FilaBarrido), cmp_fila);
+
+    // Diferencia pareada de ventas contra la primera del ranking (mismas réplicas)
+    int best = filas[0].idx;
+    for(int c=0;c<ncfg;c++){
+        double m=0.0, m2=0.0;
+        for(int r=0;r<R;r++){
+            double d = res[filas[c].idx*R+r].ventas - res[best*R+r].ventas;
+            m += d; m2 += d*d;
+        }
+        m /= R;
+        double var = (R>1)? (m2 - R*m*m)/(R-1) : 0.0;
+        filas[c].dif_ventas = m;
+        filas[c].se_dif = (var>0.0)? sqrt(var/R) : 0.0;
+    }
+
+    printf("BARRIDO: %d configuraciones x %d replicas en %.3f s\n", ncfg, R, seg);
+    printf("%4s %4s %4s %4s %6s %6s %6s %10s %9s %8s %18s\n",
+           "rank","caja","hot","cold","umbral","base","pico","ventas","espera","aband","dif_ventas(+-se)");
+    for(int c=0;c<ncfg;c++){
+        const FilaBarrido *f = &filas[c]; const Config *cf = &cfgs[f->idx];
+        printf("%4d %4d %4d %4d %6d %6.2f %6.2f %10.2f %9.3f %8.3f %9.2f (+-%6.2f)\n",
+               c+1, cf->n_caja, cf->n_hot, cf->n_cold, cf->umbral, cf->lambda_base, cf->lambda_pico,
+               f->ventas, f->espera, f->aband, f->dif_ventas, f->se_dif);
+    }
+
+    reportar_trabajadores();
+
+    if(perfiles){ for(int c=0;c<ncfg;c++) perfil_liberar(&perfiles[c]); free(perfiles); }
+    free(filas); free(res); free(cfgs);
+}
+
+// =======================
+// REGLA DE PARO SECUENCIAL
+// =======================
+// Acumulador de Welford: media y varianza en una sola pasada, sin guardar réplicas
+typedef struct { long n; double media, m2; } Welford;
+
+static inline void welford_add(Welford *w, double x){
+    w->n++;
+    double d = x - w->media;
+    w->media += d / w->n;
+    w->m2    += d * (x - w->media);
+}
+static inline double welford_var(const Welford *w){ return (w->n>1)? w->m2/(w->n-1) : 0.0; }
+
+// Cuantil 0.975 de la t de Student con gl grados de libertad (tabla corta y
+// expansión de Cornish-Fisher alrededor de z=1.96 para el resto)
+static double t_975(long gl){
+    static const double T[] = { 0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228 };
+    if(gl<1) return INFINITY;
+    if(gl<=10) return T[gl];
+    double z=1.959964, v=(double)gl, z3=z*z*z, z5=z3*z*z;
+    return z + (z3+z)/(4*v) + (5*z5+16*z3+3*z)/(96*v*v);
+}
+
+
+// Métricas por réplica que se siguen en la regla de paro
+enum Metrica { MET_VENTAS=0, MET_ESPERA, MET_THROUGHPUT, MET_ABANDONO, MET_COUNT };
+static const char *NOMBRES_METRICA[MET_COUNT] = { "ventas", "espera_min", "throughput", "abandono" };
+
+static void metricas_replica(const Resultado *r, double horizonte, double m[MET_COUNT]){
+    m[MET_VENTAS]     = r->ventas;
+    m[MET_ESPERA]     = r->compl? r->espera/r->compl : 0.0;
+    m[MET_THROUGHPUT] = r->compl / horizonte;
+    m[MET_ABANDONO]   = (r->aband + r->compl)? (double)r->aband/(r->aband + r->compl) : 0.0;
+}
+
+// =======================
+// REDUCCIÓN DE VARIANZA
+// =======================
+// Variable de control: llegadas realizadas C contra su esperanza E[C] (integral
+// del perfil). Se estima Y - b(C - E[C]) con b = cov(Y,C)/var(C) de la propia
+// muestra, lo que quita de Y la parte explicada por "llegó más/menos gente".
+// Con antitéticas la observación independiente es la media de cada pareja.
+// Welford bivariado: medias, sumas de cuadrados y co-momento de (Y, C).
+typedef struct { long n; double my, mc, syy, scc, syc; } WelfordCV;
+
+static inline void wcv_add(WelfordCV *w, double y, double c){
+    w->n++;
+    double dy = y - w->my, dc = c - w->mc;
+    w->my += dy / w->n;
+    w->mc += dc / w->n;
+    w->syy += dy * (y - w->my);
+    w->scc += dc * (c - w->mc);
+    w->syc += dy * (c - w->mc);
+}
+static inline bool wcv_usa_control(const WelfordCV *w, bool control){ return control && w->n>2 && w->scc>0.0; }
+static double wcv_media(const WelfordCV *w, bool control, double ec){
+    return wcv_usa_control(w, control)? w->my - (w->syc/w->scc)*(w->mc - ec) : w->my;
+}
+// Varianza del estimador de la media (residual de la regresión si hay control)
+static double wcv_var_media(const WelfordCV *w, bool control){
+    if(wcv_usa_control(w, control)) return (w->syy - w->syc*w->syc/w->scc) / (w->n-2) / w->n;
+    return (w->n>1)? w->syy / (w->n-1) / w->n : INFINITY;
+}
+static double wcv_semiancho(const WelfordCV *w, bool control){
+    long gl = w->n - (wcv_usa_control(w, control)? 2 : 1);
+    return (gl>=1)? t_975(gl)*sqrt(wcv_var_media(w, control)) : INFINITY;
+}
+
+// Agrega k réplicas consecutivas (k par con antitéticas): cada réplica va a ind
+// (varianza de referencia sin reducción) y cada observación a obs
+static void vr_observar(const Resultado *res, int k, double horizonte, Welford ind[MET_COUNT], WelfordCV obs[MET_COUNT]){
+    const int paso = ANTITETICAS? 2 : 1;
+    for(int j=0;j+paso<=k;j+=paso){
+        double y[MET_COUNT] = {0}, c = 0.0;
+        for(int a=0;a<paso;a++){
+            double m[MET_COUNT]; metricas_replica(&res[j+a], horizonte, m);
+            for(int q=0;q<MET_COUNT;q++){ welford_add(&ind[q], m[q]); y[q] += m[q]/paso; }
+            c += (double)res[j+a].llegadas/paso;
         }
+        for(int q=0;q<MET_COUNT;q++) wcv_add(&obs[q], y[q], c);
+    }
+}
+
+// Factor de reducción: varianza de la media con n réplicas independientes entre
+// la del estimador usado. Es también cuántas veces menos réplicas hacen falta
+// para el mismo semiancho.
+static void vr_reportar(const Welford ind[MET_COUNT], const WelfordCV obs[MET_COUNT], bool control, double ec){
+    const WelfordCV *o = &obs[0];
+    printf("reduccion: antiteticas=%s control=%s  llegadas: esperadas=%.2f observadas=%.2f\n",
+           ANTITETICAS? "si" : "no", control? "llegadas" : "no", ec, o->mc);
+    for(int q=0;q<MET_COUNT;q++){
+        double v_ind = welford_var(&ind[q]) / ind[q].n, v = wcv_var_media(&obs[q], control);
+        double rho = (obs[q].syy>0.0 && obs[q].scc>0.0)? obs[q].syc/sqrt(obs[q].syy*obs[q].scc) : 0.0;
+        printf("  %s: +-%.4f simple -> +-%.4f  corr(Y,C)=%+.3f  factor_vr=%.2f\n", NOMBRES_METRICA[q],
+               t_975(ind[q].n-1)*sqrt(v_ind), wcv_semiancho(&obs[q], control), rho, (v>0.0)? v_ind/v : 0.0);
+    }
+}
 
-        // Sumar resultados de esta réplica a los totales (OpenMP lo hace seguro)
-        ventas_tot += ventas_local; espera_tot += espera_local;
-        compl_tot  += compl_local;  aband_tot  += aband_local;
+// Lanza réplicas en lotes paralelos hasta que el semiancho del IC de la métrica
+// elegida baje de objetivo o se llegue a max_reps. Los resultados de cada lote
+// se acumulan en orden de réplica, así que el criterio de paro no depende del
+// número de hilos. Con antitéticas o control el semiancho es el del estimador
+// reducido.
+static void correr_hasta_ic(int motor, const Config *cfg, int ticks, int hilos_est,
+                            int metrica, double objetivo, int lote, int max_reps, bool control){
+    Welford ind[MET_COUNT] = {{0}};
+    WelfordCV obs[MET_COUNT] = {{0}};
+    const bool reduce = ANTITETICAS || control;
+    const double ec = perfil_integral(cfg->perfil, ticks*DT);
+    Resultado *res = (Resultado*)malloc(sizeof(Resultado)*lote);
+    int n = 0; double seg = 0.0;
 
-        cola_free(&q_caja); cola_free(&q_hot); cola_free(&q_cold);
+    while(n < max_reps){
+        int k = (max_reps - n < lote)? max_reps - n : lote;
+        if(ANTITETICAS) k &= ~1;
+        if(k<=0) break;
+        double t0 = omp_get_wtime();
+        correr_rango(motor, cfg, n, k, ticks, hilos_est, res, NULL);
+        seg += omp_get_wtime() - t0;
+
+        vr_observar(res, k, cfg->horizonte, ind, obs);
+        n += k;
+        if(wcv_semiancho(&obs[metrica], control) <= objetivo) break;
+    }
+
+    double hw_obj = wcv_semiancho(&obs[metrica], control);
+    printf("replicas=%d  (lote=%d, tope=%d, %.3f s)\n", n, lote, max_reps, seg);
+    printf("objetivo: semiancho(%s) <= %g  -> %s (%.4g)\n", NOMBRES_METRICA[metrica], objetivo,
+           hw_obj<=objetivo? "alcanzado" : "NO alcanzado", hw_obj);
+    for(int q=0;q<MET_COUNT;q++){
+        double hw = wcv_semiancho(&obs[q], control), m = wcv_media(&obs[q], control, ec);
+        printf("%s=%.4f  +-%.4f  IC95=[%.4f, %.4f]\n", NOMBRES_METRICA[q], m, hw, m-hw, m+hw);
     }
+    if(reduce) vr_reportar(ind, obs, control, ec);
+    free(res);
+}
+
+// =======================
+// MICROBENCHMARK Y PRUEBAS DE MUESTREO
+// =======================
+// Valor crítico de chi-cuadrado con p=0.001 (aprox. de Wilson-Hilferty)
+static double chi2_critico(int gl){
+    double z=3.0902, h=2.0/(9.0*gl);
+    return gl*pow(1.0 - h + z*sqrt(h), 3.0);
+}
+
+// Chi-cuadrado de una muestra continua en 100 clases equiprobables vía su CDF
+#define CLASES 100
+static double chi2_continua(double (*muestra)(RNG*), double (*cdf)(double), long n, RNG *r){
+    long cnt[CLASES]={0};
+    for(long i=0;i<n;i++){
+        int b=(int)(cdf(muestra(r))*CLASES); if(b<0) b=0; if(b>=CLASES) b=CLASES-1;
+        cnt[b]++;
+    }
+    double e=(double)n/CLASES, x2=0.0;
+    for(int b=0;b<CLASES;b++) x2+=(cnt[b]-e)*(cnt[b]-e)/e;
+    return x2;
+}
+
+// Chi-cuadrado de una muestra Poisson contra su pmf; clases con esperado < 5 se juntan
+static double chi2_poisson(int (*muestra)(double, RNG*), double lambda, long n, RNG *r, int *gl){
+    int kmax=(int)(lambda + 12.0*sqrt(lambda) + 12.0);
+    long *cnt=(long*)calloc(kmax+1, sizeof(long));
+    for(long i=0;i<n;i++){ int k=muestra(lambda, r); if(k>kmax) k=kmax; if(k<0) k=0; cnt[k]++; }
+    double *oc=(double*)malloc(sizeof(double)*(kmax+1)), *ec=(double*)malloc(sizeof(double)*(kmax+1));
+    double e_acc=0.0, o_acc=0.0, cum=0.0; int clases=0;
+    for(int k=0;k<=kmax;k++){
+        double ek = (k<kmax)? n*exp(-lambda + k*log(lambda) - lgamma(k+1.0)) : n - cum;   // la última toma la cola
+        cum += ek; e_acc += ek; o_acc += cnt[k];
+        if(e_acc>=5.0){ oc[clases]=o_acc; ec[clases]=e_acc; clases++; e_acc=0.0; o_acc=0.0; }
+    }
+    if(e_acc>0.0 || o_acc>0.0){                       // residuo de la cola a la última clase
+        if(clases>0){ oc[clases-1]+=o_acc; ec[clases-1]+=e_acc; }
+        else { oc[0]=o_acc; ec[0]=e_acc; clases=1; }
+    }
+    double x2=0.0;
+    for(int c=0;c<clases;c++) x2+=(oc[c]-ec[c])*(oc[c]-ec[c])/ec[c];
+    free(oc); free(ec);
+    free(cnt);
+    *gl = clases-1;
+    return x2;
+}
+
+static double m_expo_ref(RNG *r){ return expo(1.0, r); }
+static double m_expo_zig(RNG *r){ return expo_zig(r); }
+static double m_normal_bm(RNG *r){
+    double u1=urand(r), u2=urand(r); if(u1<=0.0) u1=1e-12;
+    return sqrt(-2.0*log(u1))*cos(2*M_PI*u2);
+}
+static double m_normal_zig(RNG *r){ return normal_zig(r); }
+static double cdf_expo(double x){ return 1.0-exp(-x); }
+static double cdf_normal(double x){ return 0.5*erfc(-x/sqrt(2.0)); }
+
+static double tiempo_continua(double (*muestra)(RNG*), long n, RNG *r, double *sink){
+    double t0=omp_get_wtime(), acc=0.0;
+    for(long i=0;i<n;i++) acc+=muestra(r);
+    *sink+=acc; return (omp_get_wtime()-t0)*1e9/n;
+}
+static double tiempo_poisson(int (*muestra)(double, RNG*), double lambda, long n, RNG *r, double *sink){
+    double t0=omp_get_wtime(); long acc=0;
+    for(long i=0;i<n;i++) acc+=muestra(lambda, r);
+    *sink+=acc; return (omp_get_wtime()-t0)*1e9/n;
+}
+
+static void fila_bench(const char *nombre, double ns_ref, double ns_new, double x2_ref, double x2_new, double crit){
+    printf("%-16s ns_ref=%7.2f ns_nuevo=%7.2f speedup=%5.2fx  chi2_ref=%8.2f chi2_nuevo=%8.2f crit=%7.2f %s\n",
+           nombre, ns_ref, ns_new, (ns_new>0.0)? ns_ref/ns_new : 0.0, x2_ref, x2_new, crit,
+           (x2_new<=crit)? "OK" : "FALLA");
+}
+
+// Tiempo por sorteo de las funciones originales contra las nuevas y prueba de
+// bondad de ajuste de ambas contra la distribución teórica. Devuelve el número
+// de pruebas fallidas del muestreador nuevo.
+static int bench_muestreo(long n){
+    RNG r; rng_init(&r, 0xFFFFFFFFu, 0xFFu);
+    double sink=0.0; int fallas=0, gl;
+    printf("MUESTREO: %ld sorteos por caso\n", n);
+
+    double x2a=chi2_continua(m_expo_ref, cdf_expo, n, &r), x2b=chi2_continua(m_expo_zig, cdf_expo, n, &r);
+    double ta=tiempo_continua(m_expo_ref, n, &r, &sink), tb=tiempo_continua(m_expo_zig, n, &r, &sink);
+    fila_bench("expo", ta, tb, x2a, x2b, chi2_critico(CLASES-1)); fallas += x2b>chi2_critico(CLASES-1);
+
+    x2a=chi2_continua(m_normal_bm, cdf_normal, n, &r); x2b=chi2_continua(m_normal_zig, cdf_normal, n, &r);
+    ta=tiempo_continua(m_normal_bm, n, &r, &sink); tb=tiempo_continua(m_normal_zig, n, &r, &sink);
+    fila_bench("normal", ta, tb, x2a, x2b, chi2_critico(CLASES-1)); fallas += x2b>chi2_critico(CLASES-1);
+
+    {   // mezcla de bebidas: búsqueda lineal contra tabla de alias
+        long ca[TIPO_COUNT]={0}, cb[TIPO_COUNT]={0}; double tot=0.0;
+        for(int i=0;i<TIPO_COUNT;i++) tot+=MEZCLA[i];
+        double t0=omp_get_wtime(); for(long i=0;i<n;i++) ca[categorical(MEZCLA, TIPO_COUNT, &r)]++; ta=(omp_get_wtime()-t0)*1e9/n;
+        t0=omp_get_wtime(); for(long i=0;i<n;i++) cb[alias_sample(&ALIAS_MEZCLA, &r)]++; tb=(omp_get_wtime()-t0)*1e9/n;
+        x2a=0.0; x2b=0.0;
+        for(int i=0;i<TIPO_COUNT;i++){
+            double e=n*MEZCLA[i]/tot;
+            x2a+=(ca[i]-e)*(ca[i]-e)/e; x2b+=(cb[i]-e)*(cb[i]-e)/e;
+        }
+        fila_bench("mezcla", ta, tb, x2a, x2b, chi2_critico(TIPO_COUNT-1)); fallas += x2b>chi2_critico(TIPO_COUNT-1);
+    }
+
+    const double lams[] = { 0.3, 0.7, 4.0, 30.0, 200.0 };
+    for(int q=0;q<(int)(sizeof(lams)/sizeof(lams[0]));q++){
+        char nombre[32]; snprintf(nombre, sizeof(nombre), "poisson(%.1f)", lams[q]);
+        int gl_b;
+        x2a=chi2_poisson(poisson_knuth, lams[q], n, &r, &gl); x2b=chi2_poisson(poisson_rapido, lams[q], n, &r, &gl_b);
+        ta=tiempo_poisson(poisson_knuth, lams[q], n, &r, &sink); tb=tiempo_poisson(poisson_rapido, lams[q], n, &r, &sink);
+        fila_bench(nombre, ta, tb, x2a, x2b, chi2_critico(gl_b)); fallas += x2b>chi2_critico(gl_b);
+    }
+
+    if(sink==42.0) printf(" ");   // evita que el compilador descarte los lazos
+    printf("pruebas_fallidas=%d\n", fallas);
+    return fallas;
+}
+
+// =======================
+// BENCHMARK DE THROUGHPUT
+// =======================
+// Reloj de pared monotónico: QueryPerformanceCounter en Windows, clock_gettime
+// en Linux. No depende del runtime de OpenMP, así que sirve también para
+// medir con distintos números de hilos.
+static double reloj_s(void){
+#ifdef _WIN32
+    static LARGE_INTEGER f; LARGE_INTEGER c;
+    if(!f.QuadPart) QueryPerformanceFrequency(&f);
+    QueryPerformanceCounter(&c);
+    return (double)c.QuadPart / (double)f.QuadPart;
+#else
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+#endif
+}
+
+// Lista "a,b,c" de enteros positivos; devuelve cuántos leyó
+static int lista_parse(const char *txt, int *v, int tope){
+    int n=0;
+    while(*txt && n<tope){
+        char *fin; long x = strtol(txt, &fin, 10);
+        if(fin==txt) break;
+        if(x>0) v[n++] = (int)x;
+        txt = (*fin==',')? fin+1 : fin;
+    }
+    return n;
+}
+
+#define BENCH_MAX_PUNTOS 16
+
+// Para cada número de hilos y de réplicas: una corrida de calentamiento y reps
+// medidas. Reporta clientes simulados, ticks y réplicas por segundo de pared
+// (en el motor de eventos los ticks son los del horizonte, como referencia).
+static void bench_throughput(const char *csv, int motor, const Config *cfg, int ticks, int hilos_est, int reps,
+                             const int *hilos, int nh, const int *replicas, int nr){
+    FILE *f = strcmp(csv, "-")? fopen(csv, "w") : stdout;
+    if(!f){ fprintf(stderr, "no se pudo abrir %s\n", csv); return; }
+    const int hilos_antes = omp_get_max_threads();
+    fprintf(f, "motor,hilos,replicas,repeticiones,seg_prom,seg_min,seg_desv,clientes,clientes_s,ticks_s,replicas_s\n");
+    for(int a=0;a<nh;a++){
+        omp_set_num_threads(hilos[a]);
+        for(int b=0;b<nr;b++){
+            int n = replicas[b];
+            Resultado *res = (Resultado*)malloc(sizeof(Resultado)*n);
+            correr_rango(motor, cfg, 0, n, ticks, hilos_est, res, NULL);   // calentamiento
+            Welford w = {0}; double mn = INFINITY;
+            for(int k=0;k<reps;k++){
+                double t0 = reloj_s();
+                correr_rango(motor, cfg, 0, n, ticks, hilos_est, res, NULL);
+                double dt = reloj_s() - t0;
+                welford_add(&w, dt); if(dt<mn) mn=dt;
+            }
+            Resultado tot = {0};
+            for(int r=0;r<n;r++) resultado_sumar(&tot, &res[r]);
+            double sp = w.media;
+            fprintf(f, "%s,%d,%d,%d,%.6f,%.6f,%.6f,%d,%.1f,%.1f,%.2f\n", NOMBRES_MOTOR[motor], hilos[a], n, reps,
+                    sp, mn, sqrt(welford_var(&w)), tot.llegadas, tot.llegadas/sp, (double)n*ticks/sp, n/sp);
+            if(f!=stdout)
+                printf("%-9s hilos=%-3d replicas=%-6d seg=%.5f  clientes/s=%.3g  ticks/s=%.3g  replicas/s=%.1f\n",
+                       NOMBRES_MOTOR[motor], hilos[a], n, sp, tot.llegadas/sp, (double)n*ticks/sp, n/sp);
+            free(res);
+        }
+    }
+    omp_set_num_threads(hilos_antes);
+    if(f!=stdout){ fclose(f); printf("bench: -> %s\n", csv); }
+}
+
+// =======================
+// GATE DE REGRESIÓN
+// =======================
+// Matriz fija de casos (motor x hilos externos) medida rep veces; cada caso
+// guarda sus muestras de segundos por corrida. El formato, la prueba de
+// Mann-Whitney y la tabla están en comun/gate.h, compartidos con estadisticas.
+#define GATE_MIN_MUESTRA  0.05   // seg mínimos por muestra (se agrupan corridas cortas)
+
+// Mide la matriz: todos los motores con 1 y 2 hilos externos, hilos_est=1.
+// El calentamiento fija cuántas corridas forman cada muestra para que ninguna
+// dure menos de GATE_MIN_MUESTRA (las muy cortas son puro ruido del reloj).
+static int gate_medir(const Config *cfg, int ticks, int reps, CasoGate *c){
+    static const int HILOS_GATE[2] = { 1, 2 };
+    const int hilos_antes = omp_get_max_threads();
+    if(reps>GATE_MAX_MUESTRAS) reps = GATE_MAX_MUESTRAS;
+    int nc = 0;
+    for(int m=0;m<MOTOR_COUNT;m++){
+        for(int a=0;a<2;a++){
+            omp_set_num_threads(HILOS_GATE[a]);
+            CasoGate *k = &c[nc++]; memset(k, 0, sizeof(*k));
+            snprintf(k->nombre, sizeof(k->nombre), "%s_h%d", NOMBRES_MOTOR[m], HILOS_GATE[a]);
+            double t0 = reloj_s();
+            correr_replicas(m, cfg, ticks, 1, NULL);
+            double t1 = reloj_s() - t0;
+            int veces = (t1>=GATE_MIN_MUESTRA)? 1 : (int)ceil(GATE_MIN_MUESTRA/(t1>1e-6? t1 : 1e-6));
+            for(int i=0;i<reps;i++){
+                t0 = reloj_s();
+                for(int v=0;v<veces;v++) correr_replicas(m, cfg, ticks, 1, NULL);
+                k->x[k->n++] = (reloj_s() - t0)/veces;
+            }
+        }
+    }
+    omp_set_num_threads(hilos_antes);
+    return nc;
+}
+
+// =======================
+// RÉPLICAS EN PROCESOS
+// =======================
+// -procesos K: las réplicas 0..n-1 se parten en shards contiguos que K
+// procesos hijos (fork) toman de un tablero en memoria compartida. Lo único
+// que cambia después del fork es la palabra de estado de cada slot: 0
+// pendiente, pid del hijo que lo corre, -1 listo, -2 fallido. Un hijo lo toma
+// con CAS 0 -> pid (acquire), escribe sus réplicas en su tramo de la tabla
+// compartida y lo publica con -1 (release); el padre lee el estado con
+// acquire antes de copiar ese tramo. ini y n se fijan antes del fork y los
+// intentos los lleva solo el padre. El padre no corre OpenMP (los hijos
+// heredan un runtime limpio): duerme en waitpid y, con cada hijo que termina,
+// copia los shards listos a su tabla privada; si el hijo cayó con un shard
+// tomado, lo devuelve a pendiente y lanza un reemplazo. La suma final va en
+// orden de r_id, igual que correr_replicas.
+#define SHARD_LISTO      (-1)
+#define SHARD_FALLIDO    (-2)
+#define SHARD_INTENTOS   3
+
+#ifndef _WIN32
+typedef struct {
+    _Atomic int estado;
+    int ini, n;          // fijos desde antes del fork
+} SlotShard;
+
+typedef struct {
+    int motor, ticks, hilos_est, hilos_hijo;
+    long mem_mb;         // tope de memoria por hijo (RLIMIT_AS), 0 = sin tope
+    const Config *cfg;
+    SlotShard *slot; int n_shards;
+    Resultado *res;      // tabla compartida, una casilla por réplica
+} Tablero;
+
+static void hijo_correr(const Tablero *tb){
+    if(tb->mem_mb>0){
+        struct rlimit rl = { (rlim_t)tb->mem_mb<<20, (rlim_t)tb->mem_mb<<20 };
+        setrlimit(RLIMIT_AS, &rl);
+    }
+    omp_set_num_threads(tb->hilos_hijo);
+    const int yo = (int)getpid();
+    for(int s=0;s<tb->n_shards;s++){
+        SlotShard *sl = &tb->slot[s];
+        int libre = 0;
+        if(!atomic_compare_exchange_strong_explicit(&sl->estado, &libre, yo, memory_order_acquire, memory_order_relaxed))
+            continue;
+        correr_rango(tb->motor, tb->cfg, sl->ini, sl->n, tb->ticks, tb->hilos_est, &tb->res[sl->ini], NULL);
+        atomic_store_explicit(&sl->estado, SHARD_LISTO, memory_order_release);
+    }
+    _exit(0);
+}
+
+static pid_t lanzar_hijo(const Tablero *tb){
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid==0) hijo_correr(tb);
+    return pid;
+}
+
+// Copia a out los shards publicados desde la última vez; los fallidos solo se cuentan
+static void juntar_shards(const Tablero *tb, bool *juntado, Resultado *out, int *listos, int *fallidos, int *juntadas){
+    for(int s=0;s<tb->n_shards;s++){
+        if(juntado[s]) continue;
+        const SlotShard *sl = &tb->slot[s];
+        int e = atomic_load_explicit(&tb->slot[s].estado, memory_order_acquire);
+        if(e==SHARD_LISTO){
+            memcpy(&out[sl->ini], &tb->res[sl->ini], sizeof(Resultado)*sl->n);
+            juntado[s] = true; (*listos)++; *juntadas += sl->n;
+        }else if(e==SHARD_FALLIDO){ juntado[s] = true; (*fallidos)++; }
+    }
+}
+
+// Devuelve cuántas réplicas se juntaron en out (las de shards fallidos quedan en 0)
+static int correr_en_procesos(int motor, const Config *cfg, int ticks, int hilos_est, int n, int procs, int tam_shard,
+                              long mem_mb, Resultado *out){
+    if(tam_shard<1) tam_shard = (n + 4*procs - 1)/(4*procs);
+    if(tam_shard<1) tam_shard = 1;
+    const int ns = (n + tam_shard - 1)/tam_shard;
+    size_t bytes = sizeof(SlotShard)*ns + sizeof(Resultado)*n;
+    pid_t *hijos = (pid_t*)calloc(procs, sizeof(pid_t));
+    int *intentos = (int*)calloc(ns, sizeof(int));
+    bool *juntado = (bool*)calloc(ns, sizeof(bool));
+    void *mem = (hijos && intentos && juntado)?
+                mmap(NULL, bytes, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0) : MAP_FAILED;
+    if(mem==MAP_FAILED){ perror("procesos: tablero"); free(hijos); free(intentos); free(juntado); return 0; }
+    Tablero tb = { motor, ticks, hilos_est, 1, mem_mb, cfg, (SlotShard*)mem, ns,
+                   (Resultado*)((char*)mem + sizeof(SlotShard)*ns) };
+    tb.hilos_hijo = omp_get_num_procs()/procs; if(tb.hilos_hijo<1) tb.hilos_hijo = 1;
+    for(int s=0;s<ns;s++){
+        tb.slot[s].ini = s*tam_shard;
+        tb.slot[s].n = (n - s*tam_shard < tam_shard)? n - s*tam_shard : tam_shard;
+        atomic_init(&tb.slot[s].estado, 0);
+    }
+
+    double t0 = reloj_s();
+    int vivos = 0;
+    for(int k=0;k<procs;k++){
+        hijos[k] = lanzar_hijo(&tb);
+        if(hijos[k]>0) vivos++; else{ perror("procesos: fork"); hijos[k] = 0; }
+    }
+    int listos = 0, fallidos = 0, reintentos = 0, juntadas = 0;
+
+    // Cada hijo que termina (bien o caído) despierta al padre
+    while(vivos>0){
+        int st; pid_t pid = waitpid(-1, &st, 0);
+        if(pid<0){ if(errno==EINTR) continue; break; }
+        int k = 0; while(k<procs && hijos[k]!=pid) k++;
+        if(k==procs) continue;
+        hijos[k] = 0; vivos--;
+        bool pendientes = false;
+        for(int s=0;s<ns;s++){
+            SlotShard *sl = &tb.slot[s];
+            // Con el hijo ya recogido nadie más escribe este slot
+            if(atomic_load_explicit(&sl->estado, memory_order_acquire)==(int)pid){
+                if(++intentos[s] >= SHARD_INTENTOS){
+                    atomic_store_explicit(&sl->estado, SHARD_FALLIDO, memory_order_release);
+                    fprintf(stderr, "procesos: shard %d (réplicas %d..%d) falló %d veces; se descarta\n",
+                            s, sl->ini, sl->ini+sl->n-1, intentos[s]);
+                }else{
+                    atomic_store_explicit(&sl->estado, 0, memory_order_release);
+                    reintentos++;
+                    fprintf(stderr, "procesos: hijo %d cayó (%s %d) con el shard %d; se reintenta\n", (int)pid,
+                            WIFSIGNALED(st)? "señal" : "código", WIFSIGNALED(st)? WTERMSIG(st) : WEXITSTATUS(st), s);
+                }
+            }
+            if(atomic_load_explicit(&sl->estado, memory_order_acquire)==0) pendientes = true;
+        }
+        juntar_shards(&tb, juntado, out, &listos, &fallidos, &juntadas);
+        // Un hijo recorre el tablero una sola vez: si quedó trabajo devuelto
+        // detrás de los demás, este lugar lo toma un proceso nuevo
+        if(pendientes){
+            hijos[k] = lanzar_hijo(&tb);
+            if(hijos[k]>0) vivos++; else{ perror("procesos: fork"); hijos[k] = 0; }
+        }
+    }
+    juntar_shards(&tb, juntado, out, &listos, &fallidos, &juntadas);
+    int perdidos = ns - listos - fallidos;   // pendientes sin hijo que los tome (fork falló)
+
+    printf("procesos: %d hijos x %d hilos, %d réplicas en %d shards de %d, %.3f s, reintentos=%d, fallidos=%d\n",
+           procs, tb.hilos_hijo, n, ns, tam_shard, reloj_s() - t0, reintentos, fallidos + perdidos);
+    free(hijos); free(intentos); free(juntado);
+    munmap(mem, bytes);
+    return juntadas;
+}
+#endif
+
+// =======================
+// ARGUMENTOS
+// =======================
+typedef struct {
+    int   motor;      // -motor pipeline|secciones|eventos|simd
+    bool  bench;      // -bench: compara secciones por tick contra pipeline persistente
+    bool  comparar;   // -comparar: resultados y tiempo del modelo por ticks vs eventos
+    bool  barrido;    // -sweep: recorre los rangos de personal y demanda
+    bool  metricas;   // -metricas: percentiles de espera (p50/p90/p99)
+    const char *serie;// -serie archivo.csv: colas y utilización por tick (implica -metricas)
+    long  muestreo;   // -bench_muestreo n: microbenchmark y pruebas de los muestreadores
+    int   reps;       // -reps k: repeticiones de la medición
+    int   hilos_est;  // -hilos_est k: hilos por réplica para el pipeline (1..EST_COUNT, por defecto 1)
+    double ic;        // -ic h: semiancho objetivo del IC al 95% (0 = R réplicas fijas)
+    int   ic_metrica; // -ic_metrica ventas|espera|throughput|abandono
+    int   lote;       // -lote k: réplicas por lote en modo -ic
+    int   max_reps;   // -max_reps k: tope de réplicas en modo -ic
+    bool  control;    // -control: variable de control con las llegadas (-antiteticas va a ANTITETICAS)
+    Rango rg[6];      // -caja -hot -cold -umbral -base -pico (a, a:b o a:b:paso)
+    const char *perfil;// -perfil archivo: tasa de llegadas por tramos (ver perfil_cargar)
+    double horizonte; // -horizonte min o -dias d (0 = según el perfil)
+    double paciencia; // -paciencia min: media de la paciencia en cola (0 = infinita)
+    bool  trabajadores;// -trabajadores: tiempo ocupado y robos por hilo al final
+    const char *bench_csv;// -bench_csv archivo|-: benchmark de throughput en CSV
+    int   bench_hilos[BENCH_MAX_PUNTOS], n_bench_hilos;       // -bench_hilos 1,2,4
+    int   bench_replicas[BENCH_MAX_PUNTOS], n_bench_replicas; // -bench_replicas 24,96
+    const char *gate;     // -gate base.json: mide la matriz y falla si hay regresiones
+    const char *gate_base;// -gate_base base.json: mide la matriz y la guarda como base
+    int   procesos;   // -procesos K: réplicas repartidas en K procesos hijos (fork)
+    int   replicas;   // -replicas n: réplicas en modo -procesos (por defecto R)
+    int   tam_shard;  // -shard k: réplicas por shard (0 = n/(4K))
+    long  mem_shard;  // -mem_shard MB: tope de memoria de cada hijo
+    const char *traza;// -traza archivo: eventos por cliente en binario columnar (ver traza_abrir)
+    bool  traza_comp; // -traza_comprimir: columnas enteras y t comprimidas
+    const char *leer_traza;// -leer_traza archivo: resume una traza mapeándola en memoria
+} Opciones;
+
+static void parse_args(int argc, char **argv, Opciones *op){
+    static const char *NOMBRES_RANGO[6] = { "-caja", "-hot", "-cold", "-umbral", "-base", "-pico" };
+    const double defs[6] = { N_CAJA, N_HOT, N_COLD, UMBRAL_LEN, LAMBDA_BASE, LAMBDA_PICO };
+    op->motor=MOTOR_PIPELINE; op->bench=false; op->comparar=false; op->barrido=false; op->reps=3; op->hilos_est=1;
+    op->metricas=false; op->serie=NULL; op->muestreo=0; op->perfil=NULL; op->horizonte=0.0; op->paciencia=PACIENCIA; op->trabajadores=false;
+    op->bench_csv=NULL; op->gate=NULL; op->gate_base=NULL; op->traza=NULL; op->traza_comp=false; op->leer_traza=NULL;
+    op->procesos=0; op->replicas=R; op->tam_shard=0; op->mem_shard=0; op->n_bench_hilos=0; op->n_bench_replicas=0; op->ic=0.0; op->control=false; op->ic_metrica=MET_VENTAS; op->lote=(omp_get_max_threads()>8)? omp_get_max_threads() : 8; op->max_reps=100000;
+    for(int k=0;k<6;k++) op->rg[k] = (Rango){ defs[k], defs[k], 1.0 };
+    for(int i=1;i<argc;i++){
+        bool es_rango=false;
+        for(int k=0;k<6;k++){
+            if(!strcmp(argv[i], NOMBRES_RANGO[k]) && i+1<argc){ op->rg[k] = rango_parse(argv[++i]); es_rango=true; break; }
+        }
+        if(es_rango) continue;
+        if(!strcmp(argv[i], "-bench")) op->bench = true;
+        else if(!strcmp(argv[i], "-comparar")) op->comparar = true;
+        else if(!strcmp(argv[i], "-sweep")) op->barrido = true;
+        else if(!strcmp(argv[i], "-metricas")) op->metricas = true;
+        else if(!strcmp(argv[i], "-serie") && i+1<argc){ op->serie = argv[++i]; op->metricas = true; }
+        else if(!strcmp(argv[i], "-bench_muestreo") && i+1<argc) op->muestreo = atol(argv[++i]);
+        else if(!strcmp(argv[i], "-orden") && i+1<argc){
+            const char *o = argv[++i];
+            orden_barrido = !strcmp(o, "espera")? 1 : (!strcmp(o, "abandono")? 2 : 0);
+        }
+        else if(!strcmp(argv[i], "-motor") && i+1<argc){
+            const char *m = argv[++i];
+            if(!strcmp(m, "secciones"))    op->motor = MOTOR_SECCIONES;
+            else if(!strcmp(m, "eventos")) op->motor = MOTOR_EVENTOS;
+            else if(!strcmp(m, "simd"))    op->motor = MOTOR_SIMD;
+            else                           op->motor = MOTOR_PIPELINE;
+        }
+        else if(!strcmp(argv[i], "-reps") && i+1<argc) op->reps = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-hilos_est") && i+1<argc) op->hilos_est = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-ic") && i+1<argc) op->ic = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-ic_metrica") && i+1<argc){
+            const char *m = argv[++i];
+            for(int q=0;q<MET_COUNT;q++) if(!strncmp(m, NOMBRES_METRICA[q], strlen(m))) { op->ic_metrica=q; break; }
+        }
+        else if(!strcmp(argv[i], "-lote") && i+1<argc) op->lote = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-max_reps") && i+1<argc) op->max_reps = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-antiteticas")) ANTITETICAS = true;
+        else if(!strcmp(argv[i], "-control")) op->control = true;
+        else if(!strcmp(argv[i], "-perfil") && i+1<argc) op->perfil = argv[++i];
+        else if(!strcmp(argv[i], "-horizonte") && i+1<argc) op->horizonte = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-dias") && i+1<argc) op->horizonte = 1440.0*atof(argv[++i]);
+        else if(!strcmp(argv[i], "-paciencia") && i+1<argc) op->paciencia = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-trabajadores")) op->trabajadores = true;
+        else if(!strcmp(argv[i], "-bench_csv") && i+1<argc) op->bench_csv = argv[++i];
+        else if(!strcmp(argv[i], "-bench_hilos") && i+1<argc) op->n_bench_hilos = lista_parse(argv[++i], op->bench_hilos, BENCH_MAX_PUNTOS);
+        else if(!strcmp(argv[i], "-bench_replicas") && i+1<argc) op->n_bench_replicas = lista_parse(argv[++i], op->bench_replicas, BENCH_MAX_PUNTOS);
+        else if(!strcmp(argv[i], "-gate") && i+1<argc) op->gate = argv[++i];
+        else if(!strcmp(argv[i], "-gate_base") && i+1<argc) op->gate_base = argv[++i];
+        else if(!strcmp(argv[i], "-procesos") && i+1<argc) op->procesos = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-replicas") && i+1<argc) op->replicas = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-shard") && i+1<argc) op->tam_shard = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-mem_shard") && i+1<argc) op->mem_shard = atol(argv[++i]);
+        else if(!strcmp(argv[i], "-traza") && i+1<argc) op->traza = argv[++i];
+        else if(!strcmp(argv[i], "-traza_comprimir")) op->traza_comp = true;
+        else if(!strcmp(argv[i], "-leer_traza") && i+1<argc) op->leer_traza = argv[++i];
+    }
+    if(op->reps<1) op->reps=1;
+    if(op->rg[3].a<0.0) op->rg[3].a=0.0;                  // -umbral negativo: cola sin espera
+    if(op->rg[3].b<op->rg[3].a) op->rg[3].b=op->rg[3].a;
+    if(op->replicas<1) op->replicas=1;
+    if(op->lote<2) op->lote=2;
+    if(op->max_reps<2) op->max_reps=2;
+    if(ANTITETICAS){ op->lote += op->lote & 1; op->max_reps += op->max_reps & 1; }   // parejas completas
+    if(op->hilos_est<1) op->hilos_est=1;
+    if(op->hilos_est>EST_COUNT) op->hilos_est=EST_COUNT;
+    // Por defecto: potencias de 2 hasta los procesadores disponibles, y R y 4R réplicas
+    if(op->n_bench_hilos==0)
+        for(int h=1; h<=omp_get_num_procs() && op->n_bench_hilos<BENCH_MAX_PUNTOS; h*=2) op->bench_hilos[op->n_bench_hilos++]=h;
+    if(op->n_bench_replicas==0){ op->bench_replicas[0]=R; op->bench_replicas[1]=4*R; op->n_bench_replicas=2; }
+}
+
+// Perfil de llegadas (archivo o el pico por defecto) y horizonte: el pedido, o
+// un periodo del perfil, o hasta su último punto, o T_MIN.
+static bool perfil_desde_opciones(const Opciones *op, Perfil *p, double *horizonte){
+    if(op->perfil){ if(!perfil_cargar(op->perfil, p)) return false; }
+    else if(!perfil_pico(p, op->rg[4].a, op->rg[5].a)) return false;
+    *horizonte = op->horizonte;
+    if(*horizonte<=0.0) *horizonte = (op->perfil && p->periodo>0.0)? p->periodo : (op->perfil? p->t[p->n-1] : T_MIN);
+    if(*horizonte<=0.0) *horizonte = T_MIN;
+    return true;
+}
+
+// Configuración fija tomada del inicio de cada rango
+static void config_desde_opciones(const Opciones *op, const Perfil *perfil, double horizonte, Config *cfg){
+    cfg->n_caja      = clamp_srv(op->rg[0].a);
+    cfg->n_hot       = clamp_srv(op->rg[1].a);
+    cfg->n_cold      = clamp_srv(op->rg[2].a);
+    cfg->umbral      = (int)floor(op->rg[3].a + 0.5);
+    cfg->lambda_base = op->rg[4].a;
+    cfg->lambda_pico = op->rg[5].a;
+    cfg->perfil      = perfil;
+    cfg->horizonte   = horizonte;
+    cfg->paciencia   = op->paciencia;
+}
+
+// Mide segundos de pared para correr las R réplicas con un motor dado
+static double medir_motor(int motor, const Config *cfg, int ticks, int hilos_est, int reps, Resultado *out){
+    Resultado res = correr_replicas(motor, cfg, ticks, hilos_est, NULL);   // calentamiento
+    double acc=0.0;
+    for(int k=0;k<reps;k++){
+        double t0 = omp_get_wtime();
+        res = correr_replicas(motor, cfg, ticks, hilos_est, NULL);
+        acc += omp_get_wtime() - t0;
+    }
+    if(out) *out = res;
+    return acc / reps;
+}
+
+// Imprime el resumen de n réplicas (prefijo vacío para la salida normal)
+static void imprimir_resumen(const char *pre, const Resultado *tot, double horizonte, int n){
+    double prom_ventas   = tot->ventas / n;
+    double prom_espera   = (tot->compl? (tot->espera/tot->compl): 0.0); // min por pedido
+    double throughput    = tot->compl / (n*horizonte);                  // pedidos/min
+    double tasa_abandono = (tot->aband + tot->compl)? ((double)tot->aband/(tot->aband+tot->compl)) : 0.0;
+
+    printf("%sprom_ventas=%.2f\n", pre, prom_ventas);
+    printf("%sprom_espera_min=%.3f\n", pre, prom_espera);
+    printf("%sthroughput(ped/min)=%.4f\n", pre, throughput);
+    printf("%stasa_abandono=%.3f\n", pre, tasa_abandono);
+}
+
+// Percentiles de espera y, si se pidió, la serie por tick promediada sobre réplicas
+static void reportar_metricas(Metricas *m, int nh, int ticks, const char *csv){
+    metricas_juntar(m, nh);
+    Histo barra = m[0].h[EST_HOT]; histo_merge(&barra, &m[0].h[EST_COLD]);
+    const Histo *hs[2] = { &m[0].h[EST_CAJA], &barra };
+    const char *nom[2] = { "caja", "barra" };
+    for(int k=0;k<2;k++)
+        printf("espera_%s_min: n=%llu p50=%.3f p90=%.3f p99=%.3f\n", nom[k], (unsigned long long)hs[k]->n,
+               histo_percentil(hs[k], 0.50), histo_percentil(hs[k], 0.90), histo_percentil(hs[k], 0.99));
+
+    if(csv){
+        FILE *f = fopen(csv, "w");
+        if(!f){ fprintf(stderr, "no se pudo abrir %s\n", csv); return; }
+        // Una fila por ventana de m->paso ticks: tick inicial y minuto final
+        fprintf(f, "tick,t_min,cola_caja,cola_hot,cola_cold,util_caja,util_hot,util_cold\n");
+        for(int fila=0;fila<m[0].filas;fila++){
+            const double *v = &m[0].serie[(size_t)fila*SER_COLS];
+            int it0 = fila*m[0].paso, it1 = (it0+m[0].paso < ticks)? it0+m[0].paso : ticks;
+            fprintf(f, "%d,%.2f", it0, it1*DT);
+            for(int c=0;c<SER_COLS;c++) fprintf(f, ",%.4f", v[c]/((double)R*(it1-it0)));
+            fprintf(f, "\n");
+        }
+        fclose(f);
+        printf("serie: %d ticks en %d filas -> %s\n", ticks, m[0].filas, csv);
+    }
+}
+
+// Cierre común de todos los modos
+static int terminar(const Opciones *op, Perfil *perfil){
+    if(op->trabajadores && !op->barrido) reportar_trabajadores();
+    perfil_liberar(perfil);
+    return 0;
+}
+
+// =======================
+// PROGRAMA PRINCIPAL
+// =======================
+int main(int argc, char **argv){
+    Opciones op; parse_args(argc, argv, &op);
+
+    // Réplicas en el nivel externo; las estaciones solo anidan si caben (hilos_anidados)
+    if(hilos_anidados(op.hilos_est) < op.hilos_est)
+        fprintf(stderr, "-hilos_est %d: %d hilos externos x %d superan %d procesadores, se usa 1 por replica\n",
+                op.hilos_est, omp_get_max_threads(), op.hilos_est, omp_get_num_procs());
+    muestreo_init();
+
+    if(op.muestreo > 0) return bench_muestreo(op.muestreo)? 1 : 0;
+    if(op.leer_traza) return traza_leer(op.leer_traza);
+
+    Perfil perfil; double horizonte;
+    if(!perfil_desde_opciones(&op, &perfil, &horizonte)) return 1;
+    const int TICKS = (int)floor(horizonte/DT + 0.5);
+
+    if(op.barrido){
+        correr_barrido(op.motor, op.rg, op.perfil? &perfil : NULL, horizonte, op.paciencia, TICKS, op.hilos_est);
+        return terminar(&op, &perfil);
+    }
+
+    Config cfg; config_desde_opciones(&op, &perfil, horizonte, &cfg);
+
+    if(op.bench_csv){
+        bench_throughput(op.bench_csv, op.motor, &cfg, TICKS, op.hilos_est, op.reps,
+                         op.bench_hilos, op.n_bench_hilos, op.bench_replicas, op.n_bench_replicas);
+        return terminar(&op, &perfil);
+    }
+
+    if(op.traza){
+        // Misma corrida sin y con traza para reportar el sobrecosto
+        if(op.procesos>0) fprintf(stderr, "-traza ignora -procesos: el escritor no sobrevive al fork\n");
+        double s_sin = medir_motor(op.motor, &cfg, TICKS, op.hilos_est, op.reps, NULL);
+        if(!traza_abrir(op.traza, op.traza_comp)){ terminar(&op, &perfil); return 1; }
+        double t0 = omp_get_wtime();
+        Resultado tot = correr_replicas(op.motor, &cfg, TICKS, op.hilos_est, NULL);
+        double s_corr = omp_get_wtime() - t0;
+        bool ok = traza_cerrar();
+        double s_con = omp_get_wtime() - t0;
+        imprimir_resumen("", &tot, horizonte, R);
+        printf("traza: %llu eventos en %llu chunks -> %s, %.2f MB (%.2f B/evento%s)%s\n",
+               (unsigned long long)TRZ.eventos, (unsigned long long)TRZ.chunks, op.traza, TRZ.off/1048576.0,
+               TRZ.eventos? (double)TRZ.off/TRZ.eventos : 0.0, op.traza_comp? ", comprimida" : "", ok? "" : "  ERROR de escritura");
+        printf("sobrecosto_traza=%.1f%%  (%.6f s con cierre, %.6f s simulando, %.6f s sin traza)\n",
+               (s_sin>0.0)? 100.0*(s_con/s_sin - 1.0) : 0.0, s_con, s_corr, s_sin);
+        printf("  escritor ocupado %.3f s, %d esperas por búfer libre, %d búferes\n", TRZ.seg_escritor, TRZ.esperas, TRZ.vivos);
+        terminar(&op, &perfil);
+        return ok? 0 : 1;
+    }
+
+    if(op.procesos>0){
+#ifdef _WIN32
+        fprintf(stderr, "-procesos requiere fork (no disponible en Windows)\n");
+        terminar(&op, &perfil);
+        return 1;
+#else
+        Resultado *res = (Resultado*)calloc(op.replicas, sizeof(Resultado));
+        int juntadas = correr_en_procesos(op.motor, &cfg, TICKS, op.hilos_est, op.replicas, op.procesos, op.tam_shard,
+                                          op.mem_shard, res);
+        Resultado tot = {0};
+        for(int r_id=0; r_id<op.replicas; ++r_id) resultado_sumar(&tot, &res[r_id]);
+        if(juntadas<op.replicas) printf("procesos: solo %d de %d réplicas completas\n", juntadas, op.replicas);
+        if(juntadas>0) imprimir_resumen("", &tot, horizonte, juntadas);
+        free(res);
+        terminar(&op, &perfil);
+        return (juntadas==op.replicas)? 0 : 1;
+#endif
+    }
+
+    if(op.gate || op.gate_base){
+        static CasoGate act[GATE_MAX_CASOS];
+        int na = gate_medir(&cfg, TICKS, op.reps, act);
+        int rc = gate_ejecutar(op.gate, op.gate_base, "simulacion_cafeteria", "seg_por_corrida", act, na);
+        terminar(&op, &perfil);
+        return rc;
+    }
+
+    if(op.bench){
+        double s_sec = medir_motor(MOTOR_SECCIONES, &cfg, TICKS, op.hilos_est, op.reps, NULL);
+        double s_pip = medir_motor(MOTOR_PIPELINE,  &cfg, TICKS, op.hilos_est, op.reps, NULL);
+        double s_simd = medir_motor(MOTOR_SIMD,     &cfg, TICKS, op.hilos_est, op.reps, NULL);
+        int hilos = omp_get_max_threads();
+        printf("SECCIONES: seg_por_corrida=%.6f  (R=%d, %d ticks)\n", s_sec, R, TICKS);
+        printf("PIPELINE:  seg_por_corrida=%.6f  (hilos_est=%d)\n", s_pip, op.hilos_est);
+        printf("SIMD:      seg_por_corrida=%.6f  (carriles=%d)  replicas/s/hilo=%.1f\n",
+               s_simd, SIMD_LANES, (s_simd>0.0)? R/s_simd/hilos : 0.0);
+        printf("SPEEDUP (secciones/pipeline) = %.2fx\n", (s_pip>0.0)? s_sec/s_pip : 0.0);
+        printf("SPEEDUP (pipeline/simd) = %.2fx\n", (s_simd>0.0)? s_pip/s_simd : 0.0);
+        return terminar(&op, &perfil);
+    }
+
+    if(op.ic > 0.0){
+        correr_hasta_ic(op.motor, &cfg, TICKS, op.hilos_est, op.ic_metrica, op.ic, op.lote, op.max_reps, op.control);
+        return terminar(&op, &perfil);
+    }
+
+    if(op.comparar){
+        Resultado r_tick, r_ev;
+        double s_tick = medir_motor(MOTOR_PIPELINE, &cfg, TICKS, op.hilos_est, op.reps, &r_tick);
+        double s_ev   = medir_motor(MOTOR_EVENTOS,  &cfg, TICKS, op.hilos_est, op.reps, &r_ev);
+        printf("TICKS:   seg_por_corrida=%.6f  (DT=%.2f min)\n", s_tick, DT);
+        imprimir_resumen("  ticks.", &r_tick, horizonte, R);
+        printf("EVENTOS: seg_por_corrida=%.6f\n", s_ev);
+        imprimir_resumen("  eventos.", &r_ev, horizonte, R);
+        printf("SPEEDUP (ticks/eventos) = %.2fx\n", (s_ev>0.0)? s_tick/s_ev : 0.0);
+        return terminar(&op, &perfil);
+    }
+
+    Resultado tot;
+    if(op.metricas){
+        // Una corrida sin métricas y otra con ellas para reportar el sobrecosto
+        int nh = omp_get_max_threads();
+        double s_sin = medir_motor(op.motor, &cfg, TICKS, op.hilos_est, op.reps, NULL);
+        Metricas *met = NULL; double s_con = 0.0;
+        for(int k=0;k<=op.reps;k++){            // k=0 es calentamiento; se reporta la última
+            if(met) metricas_liberar(met, nh);
+            met = metricas_crear(nh, TICKS);
+            double t0 = omp_get_wtime();
+            tot = correr_replicas(op.motor, &cfg, TICKS, op.hilos_est, met);
+            if(k>0) s_con += omp_get_wtime() - t0;
+        }
+        s_con /= op.reps;
+        imprimir_resumen("", &tot, horizonte, R);
+        reportar_metricas(met, nh, TICKS, op.serie);
+        printf("sobrecosto_metricas=%.1f%%  (%.6f s vs %.6f s)\n", (s_sin>0.0)? 100.0*(s_con/s_sin - 1.0) : 0.0, s_con, s_sin);
+        metricas_liberar(met, nh);
+        return terminar(&op, &perfil);
+    }
+
+    if(ANTITETICAS || op.control){
+        // Mismas R réplicas, pero se conservan por separado para el estimador reducido
+        Resultado res[R]; tot = (Resultado){0};
+        correr_rango(op.motor, &cfg, 0, R, TICKS, op.hilos_est, res, NULL);
+        for(int r_id=0; r_id<R; ++r_id) resultado_sumar(&tot, &res[r_id]);
+        imprimir_resumen("", &tot, horizonte, R);
+        Welford ind[MET_COUNT] = {{0}}; WelfordCV obs[MET_COUNT] = {{0}};
+        vr_observar(res, R, horizonte, ind, obs);
+        double ec = perfil_integral(&perfil, TICKS*DT);
+        for(int q=0;q<MET_COUNT;q++)
+            printf("%s_reducida=%.4f\n", NOMBRES_METRICA[q], wcv_media(&obs[q], op.control, ec));
+        vr_reportar(ind, obs, op.control, ec);
+        return terminar(&op, &perfil);
+    }
+
+    tot = correr_replicas(op.motor, &cfg, TICKS, op.hilos_est, NULL);
 
     // ----------------------
     // SALIDA RESUMIDA
     // ----------------------
-    double prom_ventas   = ventas_tot / R;
-    double prom_espera   = (compl_tot? (espera_tot/compl_tot): 0.0); // min por pedido
-    double throughput    = compl_tot / (R*T_MIN);                    // pedidos/min
-    double tasa_abandono = (aband_tot + compl_tot)? ((double)aband_tot/(aband_tot+compl_tot)) : 0.0;
-
-    printf("prom_ventas=%.2f\n", prom_ventas);
-    printf("prom_espera_min=%.3f\n", prom_espera);
-    printf("throughput(ped/min)=%.4f\n", throughput);
-    printf("tasa_abandono=%.3f\n", tasa_abandono);
+    imprimir_resumen("", &tot, horizonte, R);
 
-    free(lambda);
-    return 0;
+    return terminar(&op, &perfil);
 }
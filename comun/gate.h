@@ -0,0 +1,154 @@
+/* ===== Gate de regresión compartido =====
+   Lo usan simulacion_cafeteria.c y estadisticas.c (cada Makefile agrega
+   -I../comun). Cada programa mide su propia matriz de casos; aquí quedan el
+   formato JSON de las muestras, la prueba y la tabla, para que no diverjan.
+
+   Contra una base decide Mann-Whitney unilateral ("el actual es más lento")
+   sobre las repeticiones completas, y además la mediana debe empeorar al
+   menos GATE_UMBRAL. La base se mide en la máquina de referencia con
+   -gate_base y se versiona; si falta, -gate falla en vez de no comparar
+   contra nada. */
+#ifndef COMUN_GATE_H
+#define COMUN_GATE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define GATE_MAX_CASOS    32
+#define GATE_MAX_MUESTRAS 64
+#define GATE_ALFA         0.01
+#define GATE_UMBRAL       0.10
+
+typedef struct { char nombre[48]; int n; double x[GATE_MAX_MUESTRAS]; } CasoGate;
+
+static int gate_cmp_double(const void* a, const void* b){
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double gate_mediana(const double* x, int n){
+    double v[GATE_MAX_MUESTRAS]; memcpy(v, x, sizeof(double)*n);
+    qsort(v, n, sizeof(double), gate_cmp_double);
+    return (n % 2) ? v[n/2] : 0.5*(v[n/2-1] + v[n/2]);
+}
+
+/* p-valor unilateral de Mann-Whitney para "b tiende a ser mayor que a"
+   (rangos promedio en empates, aproximación normal con corrección por
+   empates y continuidad) */
+static double gate_mann_whitney_p(const double* a, int na, const double* b, int nb){
+    int n = na + nb;
+    double v[2*GATE_MAX_MUESTRAS]; int de_b[2*GATE_MAX_MUESTRAS], idx[2*GATE_MAX_MUESTRAS];
+    for(int i=0;i<na;i++){ v[i] = a[i]; de_b[i] = 0; }
+    for(int i=0;i<nb;i++){ v[na+i] = b[i]; de_b[na+i] = 1; }
+    for(int i=0;i<n;i++) idx[i] = i;
+    for(int i=1;i<n;i++){                     /* inserción: n es chico */
+        int k = idx[i], j = i-1;
+        while(j >= 0 && v[idx[j]] > v[k]){ idx[j+1] = idx[j]; j--; }
+        idx[j+1] = k;
+    }
+    double rb = 0.0, empates = 0.0;
+    for(int i=0;i<n;){
+        int j = i; while(j+1 < n && v[idx[j+1]] == v[idx[i]]) j++;
+        double rango = 0.5*(i + j) + 1.0, t = j - i + 1;
+        for(int k=i;k<=j;k++) if(de_b[idx[k]]) rb += rango;
+        empates += t*t*t - t;
+        i = j + 1;
+    }
+    double u = rb - 0.5*nb*(nb + 1);
+    double mu = 0.5*na*nb;
+    double var = na*nb/12.0 * ((n + 1) - empates/((double)n*(n - 1)));
+    if(var <= 0.0) return (u > mu) ? 0.0 : 1.0;
+    double z = (u - mu - 0.5)/sqrt(var);
+    return 0.5*erfc(z/sqrt(2.0));
+}
+
+static int gate_escribir(const char* ruta, const char* programa, const char* unidad, const CasoGate* c, int nc){
+    FILE* f = fopen(ruta, "w");
+    if(!f){ fprintf(stderr, "no se pudo abrir %s\n", ruta); return 0; }
+    fprintf(f, "{\n  \"programa\": \"%s\",\n  \"unidad\": \"%s\",\n  \"casos\": [\n", programa, unidad);
+    for(int k=0;k<nc;k++){
+        fprintf(f, "    {\"caso\": \"%s\", \"muestras\": [", c[k].nombre);
+        for(int i=0;i<c[k].n;i++) fprintf(f, "%s%.9g", i ? ", " : "", c[k].x[i]);
+        fprintf(f, "]}%s\n", (k+1 < nc) ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+/* Lector del mismo formato: cada "caso" seguido de su arreglo "muestras" */
+static int gate_leer(const char* ruta, CasoGate* c, int tope){
+    FILE* f = fopen(ruta, "rb");
+    if(!f){ fprintf(stderr, "no se pudo abrir %s\n", ruta); return -1; }
+    fseek(f, 0, SEEK_END); long len = ftell(f); fseek(f, 0, SEEK_SET);
+    char* txt = (len >= 0) ? (char*)malloc(len + 1) : NULL;
+    if(!txt){ fclose(f); fprintf(stderr, "no se pudo leer %s\n", ruta); return -1; }
+    len = (long)fread(txt, 1, len, f); txt[len] = 0; fclose(f);
+    int nc = 0;
+    for(char* p = strstr(txt, "\"caso\""); p && nc < tope; p = strstr(p, "\"caso\"")){
+        p = strchr(p + 6, '"'); if(!p) break;
+        char* fin = strchr(++p, '"'); if(!fin) break;
+        CasoGate* k = &c[nc]; memset(k, 0, sizeof(*k));
+        snprintf(k->nombre, sizeof(k->nombre), "%.*s", (int)(fin - p), p);
+        p = strstr(fin, "\"muestras\""); if(!p) break;
+        p = strchr(p, '['); if(!p) break;
+        p++;
+        while(k->n < GATE_MAX_MUESTRAS){
+            char* q; double x = strtod(p, &q);
+            if(q == p) break;
+            k->x[k->n++] = x;
+            p = q; while(*p == ' ' || *p == ',' || *p == '\n' || *p == '\r') p++;
+        }
+        if(k->n > 0) nc++;
+    }
+    free(txt);
+    return nc;
+}
+
+/* Tabla de deltas por caso; devuelve el número de regresiones significativas */
+static int gate_comparar(const CasoGate* base, int nb, const CasoGate* act, int na){
+    int regresiones = 0;
+    printf("%-24s %12s %12s %9s %9s  %s\n", "caso", "base_med", "actual_med", "delta", "p", "estado");
+    for(int k=0;k<na;k++){
+        const CasoGate* b = NULL;
+        for(int j=0;j<nb;j++) if(!strcmp(base[j].nombre, act[k].nombre)){ b = &base[j]; break; }
+        double ma = gate_mediana(act[k].x, act[k].n);
+        if(!b){ printf("%-24s %12s %12.6f %9s %9s  sin base\n", act[k].nombre, "-", ma, "-", "-"); continue; }
+        double mb = gate_mediana(b->x, b->n);
+        double delta = (mb > 0.0) ? ma/mb - 1.0 : 0.0;
+        double p_peor  = gate_mann_whitney_p(b->x, b->n, act[k].x, act[k].n);
+        double p_mejor = gate_mann_whitney_p(act[k].x, act[k].n, b->x, b->n);
+        const char* estado = "ok";
+        if(p_peor < GATE_ALFA && delta > GATE_UMBRAL){ estado = "REGRESION"; regresiones++; }
+        else if(p_mejor < GATE_ALFA && delta < -GATE_UMBRAL) estado = "mejora";
+        printf("%-24s %12.6f %12.6f %+8.1f%% %9.2g  %s\n", act[k].nombre, mb, ma, 100.0*delta,
+               (delta >= 0.0) ? p_peor : p_mejor, estado);
+    }
+    printf("gate: %d casos, %d regresiones (alfa=%.2f, umbral=%.0f%%)\n", na, regresiones, GATE_ALFA, 100.0*GATE_UMBRAL);
+    return regresiones;
+}
+
+/* -gate_base RUTA guarda la medición como base; -gate RUTA compara contra
+   ella, que tiene que existir. Devuelve el código de salida. */
+static int gate_ejecutar(const char* gate, const char* gate_base, const char* programa, const char* unidad,
+                         const CasoGate* act, int na){
+    static CasoGate base[GATE_MAX_CASOS];
+    if(gate_base){
+        if(!gate_escribir(gate_base, programa, unidad, act, na)) return 1;
+        printf("gate: base con %d casos -> %s\n", na, gate_base);
+        return 0;
+    }
+    FILE* f = fopen(gate, "rb");
+    if(!f){
+        fprintf(stderr, "gate: no existe la base %s; medirla con -gate_base (make regresion_base) "
+                        "en la máquina de referencia y versionarla\n", gate);
+        return 1;
+    }
+    fclose(f);
+    int nb = gate_leer(gate, base, GATE_MAX_CASOS);
+    if(nb <= 0){ if(nb == 0) fprintf(stderr, "gate: %s no tiene casos\n", gate); return 1; }
+    return gate_comparar(base, nb, act, na) > 0 ? 1 : 0;
+}
+
+#endif
@@ -1,17 +1,30 @@
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#include "gate.h"
 #ifdef _OPENMP
 #include <omp.h>
 #endif
+#if defined(__linux__)
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#define CON_PERF 1
+#else
+#define CON_PERF 0
+#endif
 
 /* Parámetros del modelo físico (alineados con la app gráfica) */
-#define MAX_N            100000
+#define MAX_N            10000000
 #define DEF_N            60
 #define MIN_R            16
 #define MAX_R            26
@@ -47,19 +60,76 @@ typedef struct {
     float angle, angVel, squash;
     float phase, liftCoeff, jitterT;
     uint32_t rng;
+    uint32_t id;                    /* índice original: el viento depende de él */
 } Ball;
 
+/* Almacenamiento compacto (-compacto): 40 bytes frente a 64. Radio y bandera
+   de actividad en un byte, punto fijo de 16 bits para angle/phase (vuelta
+   completa), squash ([0,2)), liftCoeff ([0,0.001)) y jitterT ([0,1)), y
+   spawnAt como float relativo a la época del mundo. Posición, velocidad y
+   angVel siguen en float: se integran cada cuadro y no toleran redondeo. */
+#define BQ_ACTIVA 0x80
+typedef struct {
+    float x, y, vx, vy, angVel;
+    float spawnAt;                  /* segundos desde World.epoca */
+    uint32_t rng;
+    uint16_t angle, phase, squash, liftCoeff, jitterT;
+    uint8_t  rf;                    /* r | BQ_ACTIVA */
+} BallQ;
+
 typedef struct {
     Ball* balls;
-    int   N, width, height, floorH;
+    BallQ* bq;                      /* en lugar de balls si compacto */
+    int   N, width, height, floorH, compacto;
     double gTime;
+    double epoca;                   /* referencia de BallQ.spawnAt */
+    int   reordenar, frame;         /* reordenamiento espacial cada 'reordenar' cuadros */
+    uint32_t *clave, *perm, *clave_tmp, *perm_tmp;
+    Ball* aux;
 } World;
 
-static inline float GroundY(World* w){ return (float)(w->height - w->floorH); }
+#define EPOCA_S 60.0                /* rebase de spawnAt cada EPOCA_S de simulación */
+
+static inline uint16_t q_vuelta(float a){
+    float t = a * (1.0f/6.2831853f); t -= floorf(t);
+    return (uint16_t)((uint32_t)(t * 65536.0f) & 0xFFFFu);
+}
+static inline float dq_vuelta(uint16_t q){ return (float)q * (6.2831853f/65536.0f); }
+static inline uint16_t q_escala(float v, float esc){
+    float t = v * esc + 0.5f;
+    return (uint16_t)(t <= 0.0f ? 0 : (t >= 65535.0f ? 65535 : (uint32_t)t));
+}
+#define ESC_SQUASH 32768.0f
+#define ESC_LIFT   65536000.0f
+#define ESC_JITTER 65536.0f
+
+/* Decodifica a un Ball local (queda en registros tras inlining) y vuelta */
+static inline void bq_decodificar(const World* w, const BallQ* q, Ball* b){
+    b->x = q->x; b->y = q->y; b->vx = q->vx; b->vy = q->vy; b->angVel = q->angVel;
+    b->spawnAt = w->epoca + (double)q->spawnAt;
+    b->rng = q->rng;
+    b->r = q->rf & 0x1F; b->active = (q->rf & BQ_ACTIVA) != 0;
+    b->angle = dq_vuelta(q->angle); b->phase = dq_vuelta(q->phase);
+    b->squash = (float)q->squash * (1.0f/ESC_SQUASH);
+    b->liftCoeff = (float)q->liftCoeff * (1.0f/ESC_LIFT);
+    b->jitterT = (float)q->jitterT * (1.0f/ESC_JITTER);
+}
+static inline void bq_codificar(const World* w, const Ball* b, BallQ* q){
+    q->x = b->x; q->y = b->y; q->vx = b->vx; q->vy = b->vy; q->angVel = b->angVel;
+    q->spawnAt = (float)(b->spawnAt - w->epoca);
+    q->rng = b->rng;
+    q->rf = (uint8_t)((b->r & 0x1F) | (b->active ? BQ_ACTIVA : 0));
+    q->angle = q_vuelta(b->angle); q->phase = q_vuelta(b->phase);
+    q->squash = q_escala(b->squash, ESC_SQUASH);
+    q->liftCoeff = q_escala(b->liftCoeff, ESC_LIFT);
+    q->jitterT = q_escala(b->jitterT, ESC_JITTER);
+}
+
+static inline float GroundY(const World* w){ return (float)(w->height - w->floorH); }
 static inline double NextIntervalRNG(uint32_t *rng){ return 0.12 + 0.12 * frand01(rng); }
 
 /* Inicializa una bola activa con valores aleatorios reproducibles */
-static void ActivateBall(World* w, Ball* b){
+static void ActivateBall(const World* w, Ball* b){
     b->rng ^= xrshift32(&b->rng);
     int r = irand_range(&b->rng, MIN_R, MAX_R); b->r = r;
     b->x = -2.0f*r - frand_range(&b->rng, 0.0f, 60.0f);
@@ -75,103 +145,407 @@ static void ActivateBall(World* w, Ball* b){
 }
 
 /* Reserva e inicializa el mundo (semilla controlada) */
-static void InitWorld(World* w, int N, int width, int height, int floorH, uint32_t seed){
+static void InitWorld(World* w, int N, int width, int height, int floorH, uint32_t seed, int compacto){
     w->N = N; w->width = width; w->height = height; w->floorH = floorH; w->gTime = 0.0;
-    w->balls = (Ball*)calloc(N, sizeof(Ball));
+    w->compacto = compacto; w->epoca = 0.0;
+    if(compacto) w->bq = (BallQ*)calloc(N, sizeof(BallQ));
+    else         w->balls = (Ball*)calloc(N, sizeof(Ball));
     uint32_t base = seed ? seed : (uint32_t)time(NULL);
     double t = 0.0;
     for(int i=0;i<N;i++){
-        w->balls[i].rng = base ^ (0x9E3779B9u * (uint32_t)(i+1));
-        w->balls[i].active = 0;
-        w->balls[i].spawnAt = t;
-        w->balls[i].squash  = 1.0f;
+        Ball b; memset(&b, 0, sizeof(b));
+        b.rng = base ^ (0x9E3779B9u * (uint32_t)(i+1));
+        b.id = (uint32_t)i;
+        b.active = 0;
+        b.spawnAt = t;
+        b.squash  = 1.0f;
+        if(compacto) bq_codificar(w, &b, &w->bq[i]); else w->balls[i] = b;
         t += 0.09 + 0.008 * (double)(i%10);
     }
 }
-static void FreeWorld(World* w){ free(w->balls); w->balls = NULL; }
+static void FreeWorld(World* w){
+    free(w->balls); free(w->bq); w->balls = NULL; w->bq = NULL;
+    free(w->clave); free(w->perm); free(w->clave_tmp); free(w->perm_tmp); free(w->aux);
+    w->clave = w->perm = w->clave_tmp = w->perm_tmp = NULL; w->aux = NULL;
+}
+
+/* Paso de una bola activa (cuerpo común a ambos almacenamientos) */
+static inline void paso_bola(const World* w, Ball* b, int i, float gy, double dt){
+    int r = b->r;
+    float prevVy = b->vy;
+
+    float wind = 70.0f*sinf((float)(1.10*w->gTime + b->phase)) + 35.0f*sinf((float)(0.63*w->gTime + i*0.19f));
+    b->vx += wind*(float)dt;
+
+    float lift = b->liftCoeff * b->angVel * b->vx;
+    b->vy += (G + lift)*(float)dt;
+    b->vx *= (1.0f - AIR*(float)dt);
+
+    b->x += b->vx*(float)dt;
+    b->y += b->vy*(float)dt;
+
+    float cy = b->y + r;
+    if (cy + r > gy){
+        float impact = fabsf(prevVy);
+        b->y  = gy - r;
+        b->vy = -b->vy * REST;
+        b->vx *= GROUND_FRICTION;
+        if (fabsf(b->vy) < 60.f) b->vy = 0.f;
+
+        float squashAmt = fminf(fmaxf(1.0f + impact/850.0f, 1.0f), 1.95f);
+        b->squash = squashAmt;
+        b->angVel += (b->vx/(float)(r))*0.35f;
+
+        if (fabsf(b->vx)>420.f && fabsf(b->vy)<30.f && (frand01(&b->rng) < (1.0f/4.0f)))
+            b->vy -= frand_range(&b->rng, 420.f, 600.f);
+    }
+
+    if (b->y < 0) { b->y = 0; b->vy = -b->vy*WALL_DAMP; }
+    if (b->x < -2*r) { b->x = -2*r; b->vx = fabsf(b->vx)*0.95f; }
+    if (b->x + 2*r > w->width) {
+        b->x  = w->width - 2*r;
+        b->vx = -fabsf(b->vx)*0.75f;
+        b->angVel *= 0.85f;
+    }
+
+    b->squash += (1.0f - b->squash)*(float)(9.0*dt);
+    if (fabsf(b->squash - 1.0f) < 0.01f) b->squash = 1.0f;
+    b->angVel *= (1.0f - 0.26f*(float)dt);
+    b->angle  += b->angVel*(float)dt;
+
+    b->jitterT += (float)dt;
+    if (b->jitterT > 0.08f){
+        b->jitterT = 0.f;
+        b->vx += frand_range(&b->rng, -60.f, 60.f);
+        if (frand01(&b->rng) < (1.0f/6.0f))
+            b->angVel += frand_range(&b->rng, -0.9f, 0.9f);
+    }
+
+    int onFloor   = fabsf((b->y+r) - gy) < 1.0f;
+    int nearRight = (b->x + 2*r) > (RIGHT_ZONE * w->width);
+    int quiet     = (fabsf(b->vx) < QUIET_VX && fabsf(b->vy) < QUIET_VY);
+    if (onFloor && nearRight && quiet) {
+        b->active = 0; b->spawnAt = w->gTime + NextIntervalRNG(&b->rng);
+    } else if (b->x - 2*r > w->width + 20) {
+        b->active = 0; b->spawnAt = w->gTime + NextIntervalRNG(&b->rng);
+    }
+}
+
+/* Almacenamiento compacto: mismas cuentas sobre valores decodificados */
+static long long UpdatePhysicsQ(World* w, double dt, int use_omp){
+    float gy = GroundY(w);
+    BallQ* bq = w->bq; int N = w->N;
+
+    /* Rebase: mantiene spawnAt relativo pequeño (precisión de float) */
+    if(w->gTime - w->epoca > EPOCA_S){
+        float d = (float)EPOCA_S;
+        #ifdef _OPENMP
+        #pragma omp parallel for if(use_omp) schedule(static)
+        #endif
+        for(int i=0;i<N;i++) bq[i].spawnAt -= d;
+        w->epoca += EPOCA_S;
+    }
+
+    float ahora = (float)(w->gTime - w->epoca);
+    for(int i=0;i<N;i++){
+        if(!(bq[i].rf & BQ_ACTIVA) && ahora >= bq[i].spawnAt){
+            Ball b; bq_decodificar(w, &bq[i], &b);
+            ActivateBall(w, &b);
+            bq_codificar(w, &b, &bq[i]);
+        }
+    }
+
+    long long activas = 0;
+    #ifdef _OPENMP
+    #pragma omp parallel for if(use_omp) schedule(static) reduction(+:activas)
+    #endif
+    for(int i=0;i<N;i++){
+        if(!(bq[i].rf & BQ_ACTIVA)) continue;
+        activas++;
+        Ball b; bq_decodificar(w, &bq[i], &b);
+        paso_bola(w, &b, i, gy, dt);
+        bq_codificar(w, &b, &bq[i]);
+    }
+    return activas;
+}
+
+/* ===== Reordenamiento espacial (-reordenar K) =====
+   Cada K cuadros las bolas se ordenan por código Morton de su tesela de
+   4x4 px; las inactivas llevan la clave máxima y quedan al final, así las
+   activas forman un bloque contiguo. Orden por radix LSD de 4 pasadas de
+   8 bits con histogramas por hilo (estable). Solo almacenamiento completo:
+   Ball.id conserva el índice original para el término de viento. */
+static inline uint32_t morton_expandir(uint32_t v){
+    v &= 0xFFFFu;
+    v = (v | (v << 8)) & 0x00FF00FFu;
+    v = (v | (v << 4)) & 0x0F0F0F0Fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
+    return v;
+}
+static inline uint32_t clave_morton(const World* w, const Ball* b){
+    if(!b->active) return 0xFFFFFFFFu;
+    float cx = b->x + b->r, cy = b->y + b->r;
+    int tx = (int)(cx * 0.25f), ty = (int)(cy * 0.25f);
+    tx = tx < 0 ? 0 : (tx > 0xFFFE ? 0xFFFE : tx);
+    ty = ty < 0 ? 0 : (ty > (w->height >> 2) ? (w->height >> 2) : ty);
+    return morton_expandir((uint32_t)tx) | (morton_expandir((uint32_t)ty) << 1);
+}
+
+/* Radix LSD estable de (clave, valor); deja el resultado en k/v */
+static void radix_ordenar(uint32_t* k, uint32_t* v, uint32_t* kt, uint32_t* vt, int n, int use_omp){
+    int nt = 1;
+    #ifdef _OPENMP
+    if(use_omp) nt = omp_get_max_threads();
+    #endif
+    size_t* hist = (size_t*)malloc(sizeof(size_t) * 256 * (size_t)nt);
+    for(int pasada=0;pasada<4;pasada++){
+        const int sh = 8*pasada;
+        #ifdef _OPENMP
+        #pragma omp parallel num_threads(nt) if(use_omp)
+        #endif
+        {
+            int t = 0, m = 1;
+            #ifdef _OPENMP
+            t = omp_get_thread_num(); m = omp_get_num_threads();
+            #endif
+            int lo = (int)((long long)n * t / m), hi = (int)((long long)n * (t+1) / m);
+            size_t* h = hist + 256*(size_t)t;
+            memset(h, 0, sizeof(size_t)*256);
+            for(int i=lo;i<hi;i++) h[(k[i] >> sh) & 0xFF]++;
+            #ifdef _OPENMP
+            #pragma omp barrier
+            #pragma omp single
+            #endif
+            {
+                size_t acc = 0;                  /* dígito mayor, hilo menor: estable */
+                for(int d=0;d<256;d++)
+                    for(int u=0;u<m;u++){ size_t c = hist[256*(size_t)u + d]; hist[256*(size_t)u + d] = acc; acc += c; }
+            }
+            for(int i=lo;i<hi;i++){
+                size_t j = h[(k[i] >> sh) & 0xFF]++;
+                kt[j] = k[i]; vt[j] = v[i];
+            }
+        }
+        uint32_t* x = k; k = kt; kt = x;
+        x = v; v = vt; vt = x;
+    }
+    free(hist);
+}
+
+static void reordenar_espacial(World* w, int use_omp){
+    int N = w->N;
+    if(!w->clave){
+        w->clave = (uint32_t*)malloc(sizeof(uint32_t)*N);     w->perm = (uint32_t*)malloc(sizeof(uint32_t)*N);
+        w->clave_tmp = (uint32_t*)malloc(sizeof(uint32_t)*N); w->perm_tmp = (uint32_t*)malloc(sizeof(uint32_t)*N);
+        w->aux = (Ball*)malloc(sizeof(Ball)*N);
+    }
+    Ball* balls = w->balls;
+    #ifdef _OPENMP
+    #pragma omp parallel for if(use_omp) schedule(static)
+    #endif
+    for(int i=0;i<N;i++){ w->clave[i] = clave_morton(w, &balls[i]); w->perm[i] = (uint32_t)i; }
+    radix_ordenar(w->clave, w->perm, w->clave_tmp, w->perm_tmp, N, use_omp);
+    #ifdef _OPENMP
+    #pragma omp parallel for if(use_omp) schedule(static)
+    #endif
+    for(int i=0;i<N;i++) w->aux[i] = balls[w->perm[i]];
+    w->balls = w->aux; w->aux = balls;
+}
 
-/* Actualiza física; puede paralelizar la parte por-bola con OpenMP */
-static void UpdatePhysics(World* w, double dt, int use_omp){
+/* Localidad: salto medio de índice en memoria entre bolas activas
+   consecutivas en orden Morton (1 = vecinos en pantalla contiguos) */
+static double salto_medio_morton(World* w){
+    int N = w->N, n = 0;
+    uint32_t *k = (uint32_t*)malloc(sizeof(uint32_t)*N), *v = (uint32_t*)malloc(sizeof(uint32_t)*N);
+    uint32_t *kt = (uint32_t*)malloc(sizeof(uint32_t)*N), *vt = (uint32_t*)malloc(sizeof(uint32_t)*N);
+    for(int i=0;i<N;i++) if(w->balls[i].active){ k[n] = clave_morton(w, &w->balls[i]); v[n] = (uint32_t)i; n++; }
+    radix_ordenar(k, v, kt, vt, n, 0);
+    double acc = 0.0;
+    for(int j=1;j<n;j++) acc += fabs((double)v[j] - (double)v[j-1]);
+    free(k); free(v); free(kt); free(vt);
+    return n > 1 ? acc / (n - 1) : 0.0;
+}
+
+/* Actualiza física; puede paralelizar la parte por-bola con OpenMP.
+   Devuelve cuántas bolas activas se actualizaron (para normalizar contadores) */
+static long long UpdatePhysics(World* w, double dt, int use_omp){
     dt *= TIME_SCALE;
+    if(w->compacto) return UpdatePhysicsQ(w, dt, use_omp);
     float gy = GroundY(w);
+    if(w->reordenar > 0 && ++w->frame % w->reordenar == 0) reordenar_espacial(w, use_omp);
     Ball* balls = w->balls; int N = w->N;
 
     for(int i=0;i<N;i++)
         if(!balls[i].active && w->gTime >= balls[i].spawnAt) ActivateBall(w, &balls[i]);
 
+    long long activas = 0;
     #ifdef _OPENMP
-    #pragma omp parallel for if(use_omp) schedule(static)
+    #pragma omp parallel for if(use_omp) schedule(static) reduction(+:activas)
     #endif
     for(int i=0;i<N;i++){
-        Ball* b = &balls[i];
-        if(!b->active) continue;
-
-        int r = b->r;
-        float prevVy = b->vy;
-
-        float wind = 70.0f*sinf((float)(1.10*w->gTime + b->phase)) + 35.0f*sinf((float)(0.63*w->gTime + i*0.19f));
-        b->vx += wind*(float)dt;
-
-        float lift = b->liftCoeff * b->angVel * b->vx;
-        b->vy += (G + lift)*(float)dt;
-        b->vx *= (1.0f - AIR*(float)dt);
+        if(!balls[i].active) continue;
+        activas++;
+        paso_bola(w, &balls[i], (int)balls[i].id, gy, dt);
+    }
+    return activas;
+}
 
-        b->x += b->vx*(float)dt;
-        b->y += b->vy*(float)dt;
+/* Reloj monotónico en segundos (QPC en Windows, clock_gettime en el resto) */
+static double reloj_s(void){
+#ifdef _WIN32
+    static LARGE_INTEGER qpf;
+    if(!qpf.QuadPart) QueryPerformanceFrequency(&qpf);
+    LARGE_INTEGER t; QueryPerformanceCounter(&t);
+    return (double)t.QuadPart / (double)qpf.QuadPart;
+#else
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9*(double)ts.tv_nsec;
+#endif
+}
 
-        float cy = b->y + r;
-        if (cy + r > gy){
-            float impact = fabsf(prevVy);
-            b->y  = gy - r;
-            b->vy = -b->vy * REST;
-            b->vx *= GROUND_FRICTION;
-            if (fabsf(b->vy) < 60.f) b->vy = 0.f;
+/* ===== Contadores de hardware (Linux: perf_event_open por hilo) =====
+   Cada hilo del equipo OpenMP abre sus propios contadores (pid=0 => hilo
+   llamante), de modo que luego se atribuyen por hilo. Se asume que libgomp
+   reutiliza los mismos hilos entre regiones con igual número de hilos.
+   Cada evento se abre suelto (sin grupo) y se escala por tiempo activo,
+   así un evento no soportado o multiplexado no invalida a los demás. */
+enum { EV_CICLOS, EV_INSTR, EV_L1D, EV_LLC, EV_RAMAS, EV_COUNT };
+static const char* NOMBRES_EV[EV_COUNT] = { "ciclos", "instr", "fallos_L1d", "fallos_LLC", "fallos_rama" };
+#define MAX_HILOS_PERF 256
 
-            float squashAmt = fminf(fmaxf(1.0f + impact/850.0f, 1.0f), 1.95f);
-            b->squash = squashAmt;
-            b->angVel += (b->vx/(float)(r))*0.35f;
+typedef struct {
+    int ok, hilos;
+    int disp[EV_COUNT];                     /* evento abierto en todos los hilos */
+    double v[MAX_HILOS_PERF][EV_COUNT];     /* valores escalados */
+    int fd[MAX_HILOS_PERF][EV_COUNT];
+    char motivo[96];
+} Contadores;
+
+#if CON_PERF
+static int perf_abrir(int ev){
+    struct perf_event_attr a; memset(&a, 0, sizeof(a));
+    a.size = sizeof(a);
+    a.disabled = 1; a.exclude_kernel = 1; a.exclude_hv = 1;
+    a.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    switch(ev){
+        case EV_CICLOS: a.type = PERF_TYPE_HARDWARE; a.config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case EV_INSTR:  a.type = PERF_TYPE_HARDWARE; a.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case EV_L1D:    a.type = PERF_TYPE_HW_CACHE;
+                        a.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16); break;
+        case EV_LLC:    a.type = PERF_TYPE_HARDWARE; a.config = PERF_COUNT_HW_CACHE_MISSES; break;
+        default:        a.type = PERF_TYPE_HARDWARE; a.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+    }
+    return (int)syscall(__NR_perf_event_open, &a, 0, -1, -1, 0);
+}
+#endif
 
-            if (fabsf(b->vx)>420.f && fabsf(b->vy)<30.f && (frand01(&b->rng) < (1.0f/4.0f)))
-                b->vy -= frand_range(&b->rng, 420.f, 600.f);
+/* Abre los contadores en cada hilo que ejecutará el bucle medido */
+static void perf_iniciar(Contadores* c, int use_omp){
+    memset(c, 0, sizeof(*c));
+    for(int t=0;t<MAX_HILOS_PERF;t++) for(int e=0;e<EV_COUNT;e++) c->fd[t][e] = -1;
+#if CON_PERF
+    int hilos = 1;
+    #ifdef _OPENMP
+    if(use_omp) hilos = omp_get_max_threads();
+    #endif
+    if(hilos > MAX_HILOS_PERF){ snprintf(c->motivo, sizeof(c->motivo), "más de %d hilos", MAX_HILOS_PERF); return; }
+    c->hilos = hilos;
+    int err = 0;
+    #ifdef _OPENMP
+    #pragma omp parallel if(use_omp)
+    #endif
+    {
+        int t = 0;
+        #ifdef _OPENMP
+        t = omp_get_thread_num();
+        #endif
+        for(int e=0;e<EV_COUNT;e++){
+            c->fd[t][e] = perf_abrir(e);
+            if(c->fd[t][e] < 0){
+                #ifdef _OPENMP
+                #pragma omp atomic write
+                #endif
+                err = errno;
+            }
         }
+    }
+    for(int e=0;e<EV_COUNT;e++){
+        c->disp[e] = 1;
+        for(int t=0;t<hilos;t++) if(c->fd[t][e] < 0) c->disp[e] = 0;
+        c->ok |= c->disp[e];
+    }
+    if(!c->ok)
+        snprintf(c->motivo, sizeof(c->motivo), "perf_event_open: %s; ver /proc/sys/kernel/perf_event_paranoid", strerror(err));
+#else
+    (void)use_omp;
+    snprintf(c->motivo, sizeof(c->motivo), "solo en Linux");
+#endif
+}
 
-        if (b->y < 0) { b->y = 0; b->vy = -b->vy*WALL_DAMP; }
-        if (b->x < -2*r) { b->x = -2*r; b->vx = fabsf(b->vx)*0.95f; }
-        if (b->x + 2*r > w->width) {
-            b->x  = w->width - 2*r;
-            b->vx = -fabsf(b->vx)*0.75f;
-            b->angVel *= 0.85f;
-        }
+/* Habilita o pausa todos los contadores abiertos (acumulan entre tramos) */
+static void perf_activar(Contadores* c, int on){
+#if CON_PERF
+    for(int t=0;t<c->hilos;t++) for(int e=0;e<EV_COUNT;e++)
+        if(c->fd[t][e] >= 0) ioctl(c->fd[t][e], on ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+#else
+    (void)c; (void)on;
+#endif
+}
 
-        b->squash += (1.0f - b->squash)*(float)(9.0*dt);
-        if (fabsf(b->squash - 1.0f) < 0.01f) b->squash = 1.0f;
-        b->angVel *= (1.0f - 0.26f*(float)dt);
-        b->angle  += b->angVel*(float)dt;
-
-        b->jitterT += (float)dt;
-        if (b->jitterT > 0.08f){
-            b->jitterT = 0.f;
-            b->vx += frand_range(&b->rng, -60.f, 60.f);
-            if (frand01(&b->rng) < (1.0f/6.0f))
-                b->angVel += frand_range(&b->rng, -0.9f, 0.9f);
-        }
+/* Lee (escalando por multiplexación) y cierra */
+static void perf_cerrar(Contadores* c){
+#if CON_PERF
+    for(int t=0;t<c->hilos;t++) for(int e=0;e<EV_COUNT;e++){
+        int fd = c->fd[t][e];
+        if(fd < 0) continue;
+        uint64_t buf[3] = {0, 0, 0};
+        if(read(fd, buf, sizeof(buf)) == (ssize_t)sizeof(buf) && buf[2] > 0)
+            c->v[t][e] = (double)buf[0] * ((double)buf[1] / (double)buf[2]);
+        close(fd); c->fd[t][e] = -1;
+    }
+#else
+    (void)c;
+#endif
+}
 
-        int onFloor   = fabsf((b->y+r) - gy) < 1.0f;
-        int nearRight = (b->x + 2*r) > (RIGHT_ZONE * w->width);
-        int quiet     = (fabsf(b->vx) < QUIET_VX && fabsf(b->vy) < QUIET_VY);
-        if (onFloor && nearRight && quiet) {
-            b->active = 0; b->spawnAt = w->gTime + NextIntervalRNG(&b->rng);
-        } else if (b->x - 2*r > w->width + 20) {
-            b->active = 0; b->spawnAt = w->gTime + NextIntervalRNG(&b->rng);
+/* IPC y fallos por actualización de bola; detalle por hilo */
+static void perf_reportar(const char* modo, const Contadores* c, long long act){
+    if(!c->ok){ printf("%s: contadores de hardware no disponibles (%s)\n", modo, c->motivo); return; }
+    double tot[EV_COUNT] = {0};
+    for(int t=0;t<c->hilos;t++) for(int e=0;e<EV_COUNT;e++) tot[e] += c->v[t][e];
+    for(int t=0;t<c->hilos;t++){
+        printf("  %s hilo %2d:", modo, t);
+        for(int e=0;e<EV_COUNT;e++){
+            if(c->disp[e]) printf(" %s=%.3e", NOMBRES_EV[e], c->v[t][e]);
+            else printf(" %s=n/d", NOMBRES_EV[e]);
         }
+        if(c->disp[EV_CICLOS] && c->disp[EV_INSTR] && c->v[t][EV_CICLOS] > 0)
+            printf(" IPC=%.2f", c->v[t][EV_INSTR] / c->v[t][EV_CICLOS]);
+        printf("\n");
     }
+    printf("%s:", modo);
+    if(c->disp[EV_CICLOS] && c->disp[EV_INSTR] && tot[EV_CICLOS] > 0) printf(" IPC=%.2f", tot[EV_INSTR] / tot[EV_CICLOS]);
+    printf("  por actualización de bola (%lld):", act);
+    for(int e=0;e<EV_COUNT;e++){
+        if(!c->disp[e]) printf(" %s=n/d", NOMBRES_EV[e]);
+        else printf(" %s=%.4f", NOMBRES_EV[e], act > 0 ? tot[e] / (double)act : 0.0);
+    }
+    printf("\n");
 }
 
 /* Argumentos de línea de comandos */
 static void parse_args(int argc, char** argv, int* outN, int* outFrames, uint32_t* outSeed,
-                       int* outW, int* outH, int* outReps){
+                       int* outW, int* outH, int* outReps, int* outPerf, int* outCompacto,
+                       const char** outGate, const char** outGateBase, int* outReordenar){
     int Nval = 400, F = 100000, R = 3, W=960, H=560; uint32_t seed = 12345;
+    *outPerf = 1; *outCompacto = 0; *outGate = NULL; *outGateBase = NULL; *outReordenar = 0;
     for(int i=1;i<argc;i++){
+        if(!strcmp(argv[i], "-reordenar") && i+1<argc) { *outReordenar = atoi(argv[++i]); continue; }
+        if(!strcmp(argv[i], "-gate") && i+1<argc) { *outGate = argv[++i]; continue; }
+        if(!strcmp(argv[i], "-gate_base") && i+1<argc) { *outGateBase = argv[++i]; continue; }
+        if(!strcmp(argv[i], "-compacto")) { *outCompacto = 1; continue; }
+        if(!strcmp(argv[i], "-sin_perf")) { *outPerf = 0; continue; }
         if(!strcmp(argv[i], "-n") && i+1<argc) { Nval = atoi(argv[++i]); }
         else if(!strcmp(argv[i], "-frames") && i+1<argc) { F = atoi(argv[++i]); }
         else if(!strcmp(argv[i], "-seed") && i+1<argc) { seed = (uint32_t)strtoul(argv[++i], NULL, 10); }
@@ -184,52 +558,121 @@ static void parse_args(int argc, char** argv, int* outN, int* outFrames, uint32_
     *outN = Nval; *outFrames = F; *outSeed = seed; *outW=W; *outH=H; *outReps=R;
 }
 
-/* Ejecuta una medición: ms por frame con warmup previo */
-static double medir_una(World* w, int frames, int use_omp){
+/* Ejecuta una medición: ms por frame con warmup previo; los contadores
+   (si los hay) solo corren durante el bucle medido */
+static double medir_una(World* w, int frames, int use_omp, Contadores* pc, long long* act){
     const double dt = 1.0/60.0;
-    LARGE_INTEGER qpf; QueryPerformanceFrequency(&qpf);
-    LARGE_INTEGER t0, t1;
 
     for(int i=0;i<100;i++){ w->gTime += dt; UpdatePhysics(w, dt, use_omp); }
 
-    QueryPerformanceCounter(&t0);
-    for(int i=0;i<frames;i++){ w->gTime += dt; UpdatePhysics(w, dt, use_omp); }
-    QueryPerformanceCounter(&t1);
+    long long a = 0;
+    if(pc) perf_activar(pc, 1);
+    double t0 = reloj_s();
+    for(int i=0;i<frames;i++){ w->gTime += dt; a += UpdatePhysics(w, dt, use_omp); }
+    double t1 = reloj_s();
+    if(pc) perf_activar(pc, 0);
+    *act += a;
 
-    double ms_total = 1000.0 * (double)(t1.QuadPart - t0.QuadPart) / (double)qpf.QuadPart;
-    return ms_total / (double)frames;
+    return 1000.0 * (t1 - t0) / (double)frames;
+}
+
+/* ===== Gate de regresión =====
+   Matriz fija de casos (N, almacenamiento, SEC/OMP) medida reps veces; cada
+   caso guarda sus muestras de ms/frame. El formato, la prueba de Mann-Whitney
+   y la tabla están en comun/gate.h, compartidos con la cafetería. */
+/* Matriz fija: frames elegidos para que cada muestra dure decenas de ms */
+static int gate_medir(int reps, uint32_t seed, int W, int H, CasoGate* c){
+    static const struct { int n, frames, compacto; } MATRIZ[3] = {
+        { 400, 10000, 0 }, { 20000, 2000, 0 }, { 1000000, 10, 1 }
+    };
+    if(reps > GATE_MAX_MUESTRAS) reps = GATE_MAX_MUESTRAS;
+    int nc = 0;
+    for(int m=0;m<3;m++){
+        for(int use_omp=0;use_omp<2;use_omp++){
+            CasoGate* k = &c[nc++]; memset(k, 0, sizeof(*k));
+            snprintf(k->nombre, sizeof(k->nombre), "n%d_%s%s", MATRIZ[m].n,
+                     MATRIZ[m].compacto ? "compacto_" : "", use_omp ? "omp" : "sec");
+            for(int r=0;r<reps;r++){
+                long long act = 0;
+                World w = {0}; InitWorld(&w, MATRIZ[m].n, W, H, 48, seed, MATRIZ[m].compacto);
+                k->x[k->n++] = medir_una(&w, MATRIZ[m].frames, use_omp, NULL, &act);
+                FreeWorld(&w);
+            }
+        }
+    }
+    return nc;
+}
+
+/* Misma corrida OMP con y sin reordenamiento: ms/frame y salto medio de
+   índice entre vecinos espaciales al final */
+static void medir_localidad(int N, int frames, uint32_t seed, int W, int H, int k){
+    double ms[2], salto[2];
+    for(int c=0;c<2;c++){
+        long long act = 0;
+        World w = {0}; InitWorld(&w, N, W, H, 48, seed, 0); w.reordenar = c ? k : 0;
+        ms[c] = medir_una(&w, frames, 1, NULL, &act);
+        salto[c] = salto_medio_morton(&w);
+        FreeWorld(&w);
+    }
+    printf("LOCALIDAD (OMP): sin reordenar ms_per_frame=%.6f salto_medio=%.1f | reordenar cada %d: ms_per_frame=%.6f salto_medio=%.1f | %.2fx\n",
+           ms[0], salto[0], k, ms[1], salto[1], ms[1] > 0.0 ? ms[0]/ms[1] : 0.0);
 }
 
 /* Punto de entrada: promedia repeticiones y calcula speedup */
 int main(int argc, char** argv){
-    int N, frames, reps, W, H; uint32_t seed;
-    parse_args(argc, argv, &N, &frames, &seed, &W, &H, &reps);
+    int N, frames, reps, W, H, perf, compacto, reordenar; uint32_t seed;
+    const char *gate, *gate_base;
+    parse_args(argc, argv, &N, &frames, &seed, &W, &H, &reps, &perf, &compacto, &gate, &gate_base, &reordenar);
+    if(compacto && reordenar > 0){
+        printf("-reordenar no aplica a -compacto (BallQ no guarda id); se ignora\n");
+        reordenar = 0;
+    }
+
+    if(gate || gate_base){
+        static CasoGate act[GATE_MAX_CASOS];
+        int na = gate_medir(reps, seed, W, H, act);
+        return gate_ejecutar(gate, gate_base, "estadisticas", "ms_per_frame", act, na);
+    }
+
+    static Contadores pc_sec, pc_omp;
+    long long act_sec = 0, act_omp = 0;
+    if(perf) perf_iniciar(&pc_sec, 0);
 
     double acc_sec = 0.0;
     for(int r=0;r<reps;r++){
-        World w = {0}; InitWorld(&w, N, W, H, 48, seed + r);
-        double mspf = medir_una(&w, frames, 0);
+        World w = {0}; InitWorld(&w, N, W, H, 48, seed + r, compacto); w.reordenar = reordenar;
+        double mspf = medir_una(&w, frames, 0, perf ? &pc_sec : NULL, &act_sec);
         acc_sec += mspf;
         FreeWorld(&w);
     }
     double ms_sec = acc_sec / (double)reps;
     double fps_sec = 1000.0 / ms_sec;
 
+    if(perf){ perf_cerrar(&pc_sec); perf_iniciar(&pc_omp, 1); }
+
     double acc_omp = 0.0;
     for(int r=0;r<reps;r++){
-        World w = {0}; InitWorld(&w, N, W, H, 48, seed + r);
-        double mspf = medir_una(&w, frames, 1);
+        World w = {0}; InitWorld(&w, N, W, H, 48, seed + r, compacto); w.reordenar = reordenar;
+        double mspf = medir_una(&w, frames, 1, perf ? &pc_omp : NULL, &act_omp);
         acc_omp += mspf;
         FreeWorld(&w);
     }
+    if(perf) perf_cerrar(&pc_omp);
     double ms_omp = acc_omp / (double)reps;
     double fps_omp = 1000.0 / ms_omp;
 
     double speedup = (ms_omp > 0.0) ? (ms_sec / ms_omp) : 0.0;
 
+    printf("N=%d  almacenamiento=%s  bytes_por_bola=%zu  (%.1f MB)\n", N, compacto ? "compacto" : "completo",
+           compacto ? sizeof(BallQ) : sizeof(Ball), (double)N * (compacto ? sizeof(BallQ) : sizeof(Ball)) / 1048576.0);
     printf("SEC: ms_per_frame=%.6f  fps=%.2f\n", ms_sec, fps_sec);
     printf("OMP: ms_per_frame=%.6f  fps=%.2f\n", ms_omp, fps_omp);
     printf("SPEEDUP (seq/omp) = %.2fx\n", speedup);
+    if(perf){
+        perf_reportar("SEC", &pc_sec, act_sec);
+        perf_reportar("OMP", &pc_omp, act_omp);
+    }
+    if(reordenar > 0) medir_localidad(N, frames, seed, W, H, reordenar);
 
     return 0;
 }
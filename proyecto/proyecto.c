@@ -1,19 +1,32 @@
 #include <windows.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <time.h>
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
+#ifdef _MSC_VER
+#define FORCE_INLINE __forceinline
+#else
+#define FORCE_INLINE inline __attribute__((always_inline))
+#endif
+#ifdef _OPENMP
+#define OMP_PARALLEL_FOR _Pragma("omp parallel for schedule(static)")
+#else
+#define OMP_PARALLEL_FOR
+#endif
+
 #ifdef _MSC_VER
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "gdi32.lib")
 #pragma comment(lib, "msimg32.lib")
 #endif
 
-#define MAX_N 800
+#define MAX_N 1000000
 #define DEF_N 60
 #define MIN_R 16
 #define MAX_R 26
@@ -24,8 +37,14 @@
 #define QUIET_VY 40.0f
 #define ENABLE_TRAILS 1
 #define TRAIL_LEN 10
+#define TRAIL_FADE_Q8 200      /* estela acumulada: factor de desvanecido por cuadro (x/256) */
 #define ENABLE_SPARKS 1
-#define MAX_PARTICLES 1800
+#define PARTICLES_CAP0 2048   /* capacidad inicial; el pool crece a demanda */
+#define LOD_UMBRAL 5000        /* con más bolas se dibuja el mapa de densidad */
+#define PALETA_NIVELES 6       /* niveles por canal: 216 colores, 2 pinceles c/u */
+#define LOD_SPRITES 256        /* bolas muestreadas que conservan sprite completo */
+#define LOD_LLENADO_S 8.0      /* en LOD la primera oleada entra en ~8 s sea cual sea N */
+#define LOD_VEL_REF 900.0f     /* rapidez media que satura el tinte cálido */
 
 typedef struct {
     float x,y;
@@ -42,28 +61,39 @@ typedef struct {
     float phase;
     float liftCoeff;
     float jitterT;
-#if ENABLE_TRAILS
-    float trailX[TRAIL_LEN], trailY[TRAIL_LEN];
-    int trailCount;
-#endif
+    uint32_t rng;              /* xorshift32 propio: sin región crítica al sortear */
 } Ball;
 
+/* Historia de la estela de puntos, aparte de Ball: en LOD (estela apagada)
+   no se reserva y a 10^6 bolas eso son ~80 MB menos */
 typedef struct {
-    BOOL alive;
-    float x,y,vx,vy,life,maxLife;
-    int size;
-    HBRUSH brush;
-} Particle;
+    float x[TRAIL_LEN], y[TRAIL_LEN];
+    int count;
+} Trail;
+
+/* Chispas vivas empacadas en arreglos SoA [0,n): la física recorre solo
+   floats contiguos y el pincel/tamaño (datos fríos, solo para dibujar) van
+   aparte. Dos juegos de arreglos: la actualización lee de uno y compacta las
+   vivas en el otro, así no hace falta marcar ni buscar huecos. */
+typedef struct {
+    int n, cap;
+    float *x,*y,*vx,*vy,*life,*maxLife;
+    unsigned char *size;
+    HBRUSH *brush;
+} Particles;
 
 static Ball *balls=NULL;
+static Trail *trails=NULL;         /* NULL en LOD */
 static int N=DEF_N;
-static Particle gParticles[MAX_PARTICLES];
+static Particles gPart[2];
+static int gCur=0;                 /* juego con las chispas vigentes */
 static HWND hwnd;
 static RECT client;
 static int width=960,height=560,floorH=48;
 static BOOL running=TRUE;
 static HDC backDC=NULL;
 static HBITMAP backBMP=NULL, backOld=NULL;
+static unsigned int* backBits=NULL;    /* solo en modo offline (DIB top-down) */
 static const float G=2000.0f;
 static const float REST=0.80f;
 static const float AIR=0.018f;
@@ -71,6 +101,36 @@ static const float GROUND_FRICTION=0.984f;
 static const float WALL_DAMP=0.88f;
 static double gTime=0.0;
 static HBRUSH gPortalBrush=NULL;
+/* Pinceles compartidos: cada bola apunta a los de su color de la paleta, así
+   los handles GDI no crecen con N (la cuota por proceso es ~10000) y las
+   chispas pueden guardar el pincel sin que se libere al reactivarse la bola */
+#define PALETA_COLORES (PALETA_NIVELES*PALETA_NIVELES*PALETA_NIVELES)
+static HBRUSH gPaleta[PALETA_COLORES], gPaletaSombra[PALETA_COLORES];
+
+/* Efectos activos en tiempo de ejecución (ver SelectBallKernel) */
+enum { FX_TRAILS=1, FX_SPARKS=2, FX_WIND=4, FX_JITTER=8 };
+static unsigned gFx=(ENABLE_TRAILS?FX_TRAILS:0)|(ENABLE_SPARKS?FX_SPARKS:0)|FX_WIND|FX_JITTER;
+
+/* Modo de estela: puntos históricos (TRAIL_LEN elipses por bola) o capa
+   acumulada persistente que se desvanece cada cuadro */
+enum { TRAIL_PUNTOS=0, TRAIL_ACUM=1 };
+static int gTrailMode=TRAIL_PUNTOS;
+static HDC trailDC=NULL;
+static HBITMAP trailBMP=NULL, trailOld=NULL;
+static unsigned int* trailBits=NULL;   /* BGRA premultiplicado, top-down */
+
+/* Nivel de detalle: sobre gLodUmbral bolas cada una se acumula como un
+   punto en una rejilla de conteo/rapidez por píxel que se mapea a color en
+   una pasada; solo 1 de cada gLodPaso bolas se dibuja como sprite */
+static int gLodUmbral=LOD_UMBRAL;
+static BOOL gLod=FALSE;
+static int gLodPaso=1;
+static unsigned int* lodCnt=NULL;
+static float* lodVel=NULL;
+static int lodW=0, lodH=0;
+static HDC lodDC=NULL;
+static HBITMAP lodBMP=NULL, lodOld=NULL;
+static unsigned int* lodBits=NULL;     /* BGRA premultiplicado, top-down */
 
 /* Utilidades básicas */
 static COLORREF Darken(COLORREF c,int pct){int r=GetRValue(c),g=GetGValue(c),b=GetBValue(c);r=r*(100-pct)/100;g=g*(100-pct)/100;b=b*(100-pct)/100;return RGB(r,g,b);}
@@ -78,96 +138,211 @@ static float GroundY(){return (float)(height-floorH);}
 static int clampi(int v,int a,int b){return v<a?a:(v>b?b:v);}
 static float clampf(float v,float a,float b){return v<a?a:(v>b?b:v);}
 
-/* RNG seguro en paralelo (usa región crítica) */
-static int rand_inclusive_safe(int lo, int hi){
-    int v;
-    #ifdef _OPENMP
-    #pragma omp critical(rng)
-    #endif
-    { v = lo + (rand() % (hi - lo + 1)); }
-    return v;
+/* RNG por bola (xorshift32, como en estadisticas.c): cada hilo sortea con
+   el estado de la bola que actualiza, sin región crítica compartida */
+static inline uint32_t xrshift32(uint32_t *s){
+    uint32_t x = *s ? *s : 0x9E3779B9u;
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    *s = x; return x;
+}
+static inline int irand_range(uint32_t *s,int lo,int hi){
+    int v=lo+(int)((xrshift32(s)>>8)*(1.0f/16777216.0f)*(float)(hi-lo+1));
+    return v>hi? hi : v;
 }
 
-/* Intervalo de reaparición seguro en paralelo */
-static double NextIntervalSafe(){
-    double v;
-    #ifdef _OPENMP
-    #pragma omp critical(rng)
-    #endif
-    { v = 0.12 + (rand()%10)*0.012; }
-    return v;
+/* Intervalo de reaparición con el RNG de la bola */
+static double NextIntervalRNG(uint32_t *rng){ return 0.12 + irand_range(rng,0,9)*0.012; }
+
+/* Nivel k de un canal de la paleta, repartido en [40,239] */
+static int PaletaNivel(int k){ return 40 + k*199/(PALETA_NIVELES-1); }
+
+/* Crea los pinceles de la paleta (una vez); si GDI se queda sin handles se
+   usa un pincel de stock para no seleccionar NULL */
+static void MakePalette(){
+    if(gPaleta[0]) return;
+    for(int k=0;k<PALETA_COLORES;k++){
+        int cr=k/(PALETA_NIVELES*PALETA_NIVELES), cg=(k/PALETA_NIVELES)%PALETA_NIVELES, cb=k%PALETA_NIVELES;
+        COLORREF c=RGB(PaletaNivel(cr),PaletaNivel(cg),PaletaNivel(cb));
+        gPaleta[k]=CreateSolidBrush(c);
+        gPaletaSombra[k]=CreateSolidBrush(Darken(c,75));
+        if(!gPaleta[k]) gPaleta[k]=(HBRUSH)GetStockObject(GRAY_BRUSH);
+        if(!gPaletaSombra[k]) gPaletaSombra[k]=(HBRUSH)GetStockObject(DKGRAY_BRUSH);
+    }
+}
+
+static void FreePalette(){
+    for(int k=0;k<PALETA_COLORES;k++){
+        if(gPaleta[k]) DeleteObject(gPaleta[k]);            /* los de stock lo ignoran */
+        if(gPaletaSombra[k]) DeleteObject(gPaletaSombra[k]);
+        gPaleta[k]=gPaletaSombra[k]=NULL;
+    }
 }
 
 /* Gestión de memoria y pinceles */
 static void FreeBalls(){
-    if(!balls) return;
-    for(int i=0;i<N;i++){ if(balls[i].brush) DeleteObject(balls[i].brush); if(balls[i].shadow) DeleteObject(balls[i].shadow); }
+    free(trails); trails=NULL;
     free(balls); balls=NULL;
+    FreePalette();
     if(gPortalBrush){ DeleteObject(gPortalBrush); gPortalBrush=NULL; }
 }
 
-static void MakeBrushes(Ball* b){
-    if(b->brush) DeleteObject(b->brush);
-    if(b->shadow) DeleteObject(b->shadow);
-    b->brush=CreateSolidBrush(b->color);
-    b->shadow=CreateSolidBrush(Darken(b->color,75));
-}
-
 static double NextInterval(){ return 0.12 + (rand()%10)*0.012; }
 
-static void ParticlesClear(){ for(int i=0;i<MAX_PARTICLES;i++) gParticles[i].alive=FALSE; }
+static void ParticlesClear(){ gPart[0].n=gPart[1].n=0; }
 
-/* Emisión de partículas; protege acceso al pool con región crítica */
+/* Garantiza capacidad para 'need' chispas en ambos juegos (crece x2). Cada
+   arreglo crece por un temporal: si un realloc falla, los ya crecidos solo
+   quedan más grandes, cap no cambia y se devuelve FALSE (el que emite
+   recorta la ráfaga a lo que cabe, como el pool fijo original). */
+#define PARTICLES_CRECER(ptr,n) \
+    do{ void* q_=realloc((ptr),(size_t)(n)*sizeof(*(ptr))); if(!q_) return FALSE; (ptr)=q_; }while(0)
+static BOOL ParticlesReserve(int need){
+    if(need<=gPart[0].cap) return TRUE;
+    int cap=gPart[0].cap? gPart[0].cap : PARTICLES_CAP0;
+    while(cap<need) cap*=2;
+    for(int k=0;k<2;k++){
+        Particles* P=&gPart[k];
+        PARTICLES_CRECER(P->x,cap);    PARTICLES_CRECER(P->y,cap);
+        PARTICLES_CRECER(P->vx,cap);   PARTICLES_CRECER(P->vy,cap);
+        PARTICLES_CRECER(P->life,cap); PARTICLES_CRECER(P->maxLife,cap);
+        PARTICLES_CRECER(P->size,cap); PARTICLES_CRECER(P->brush,cap);
+    }
+    gPart[0].cap=gPart[1].cap=cap;
+    return TRUE;
+}
+
+static void ParticlesFree(){
+    for(int k=0;k<2;k++){
+        Particles* P=&gPart[k];
+        free(P->x); free(P->y); free(P->vx); free(P->vy); free(P->life); free(P->maxLife); free(P->size); free(P->brush);
+        memset(P,0,sizeof(*P));
+    }
+}
+
+/* Emisión de partículas: una región crítica por ráfaga (no por chispa); se
+   añaden al final del juego vigente y solo se descartan si el pool no puede
+   crecer */
 static void SpawnSparks(float x,float y,int count,HBRUSH brush,float baseVx){
 #if ENABLE_SPARKS
     if(count<=0) return;
-    for(int k=0;k<count;k++){
-        int idx=-1;
-        #ifdef _OPENMP
-        #pragma omp critical(sparks)
-        #endif
-        {
-            for(int i=0;i<MAX_PARTICLES;i++){ if(!gParticles[i].alive){ idx=i; break; } }
-            if(idx>=0){
-                Particle* p=&gParticles[idx];
-                p->alive=TRUE; p->x=x; p->y=y;
-                float a=((float)(rand()%360))*(3.14159265f/180.f);
-                float sp=140.0f+(float)(rand()%160);
-                float fwd=baseVx*0.25f;
-                p->vx=cosf(a)*sp+fwd;
-                p->vy=-fabsf(sinf(a))*sp*0.95f - 60.f;
-                p->maxLife=0.28f+0.30f*((float)(rand()%100)/100.f);
-                p->life=p->maxLife;
-                p->size=2+rand()%3;
-                p->brush=brush?brush:(HBRUSH)GetStockObject(WHITE_BRUSH);
-            }
+    if(!brush) brush=(HBRUSH)GetStockObject(WHITE_BRUSH);
+    #ifdef _OPENMP
+    #pragma omp critical(sparks)
+    #endif
+    {
+        Particles* P=&gPart[gCur];
+        if(!ParticlesReserve(P->n+count)) count=P->cap-P->n;   /* sin memoria: lo que quepa */
+        for(int k=0;k<count;k++){
+            int i=P->n++;
+            float a=((float)(rand()%360))*(3.14159265f/180.f);
+            float sp=140.0f+(float)(rand()%160);
+            float fwd=baseVx*0.25f;
+            P->x[i]=x; P->y[i]=y;
+            P->vx[i]=cosf(a)*sp+fwd;
+            P->vy[i]=-fabsf(sinf(a))*sp*0.95f - 60.f;
+            P->maxLife[i]=0.28f+0.30f*((float)(rand()%100)/100.f);
+            P->life[i]=P->maxLife[i];
+            P->size[i]=(unsigned char)(2+rand()%3);
+            P->brush[i]=brush;
         }
-        if(idx<0) break;
     }
 #else
     (void)x;(void)y;(void)count;(void)brush;(void)baseVx;
 #endif
 }
 
-/* Actualización de partículas en paralelo; dibujo sigue secuencial */
-static void ParticlesUpdate(double dt){
+/* Actualización sin ramas (selects vectorizables) sobre las n vivas y luego
+   compactación de las que siguen vivas hacia el otro juego. Con pocas
+   chispas todo va en un tramo; con muchas, cada tramo cuenta sus vivas, un
+   prefijo da los desplazamientos y cada uno copia lo suyo. Por fases los
+   tramos son los hilos de un parallel; dentro del grafo de tareas (donde un
+   parallel anidado tendría un solo hilo) son dos taskloop. */
+#define PARTICLES_PAR_MIN 8192
 #if ENABLE_SPARKS
-    float gy=GroundY();
+static int ParticlesAvanzar(Particles* A,int lo,int hi,float fdt,float gy){
+    const float g=G*0.35f*fdt, drag=1.0f-0.035f*fdt;
+    float *x=A->x,*y=A->y,*vx=A->vx,*vy=A->vy,*life=A->life;
+    #ifdef _OPENMP
+    #pragma omp simd
+    #endif
+    for(int i=lo;i<hi;i++){
+        life[i]-=fdt;
+        float nvy=vy[i]+g, nvx=vx[i]*drag;
+        float nx=x[i]+nvx*fdt, ny=y[i]+nvy*fdt;
+        int hit=ny>gy;
+        float bvy=-nvy*0.30f;
+        bvy=(fabsf(bvy)<16.f)? 0.f : bvy;
+        y[i]=hit? gy : ny;
+        vy[i]=hit? bvy : nvy;
+        vx[i]=hit? nvx*0.84f : nvx;
+        x[i]=nx;
+    }
+    int cnt=0;
+    for(int i=lo;i<hi;i++) cnt+=life[i]>0.f;
+    return cnt;
+}
+
+static void ParticlesCompactar(const Particles* A,Particles* B,int lo,int hi,int j){
+    for(int i=lo;i<hi;i++){
+        if(!(A->life[i]>0.f)) continue;
+        B->x[j]=A->x[i]; B->y[j]=A->y[i]; B->vx[j]=A->vx[i]; B->vy[j]=A->vy[i];
+        B->life[j]=A->life[i]; B->maxLife[j]=A->maxLife[i]; B->size[j]=A->size[i]; B->brush[j]=A->brush[i];
+        j++;
+    }
+}
+#endif
+
+static void ParticlesUpdate(double dt,BOOL tareas){
+#if ENABLE_SPARKS
+    Particles* A=&gPart[gCur]; Particles* B=&gPart[gCur^1];
+    const int n=A->n;
+    const float gy=GroundY(), fdt=(float)dt;
+    int nth=1;
     #ifdef _OPENMP
-    #pragma omp parallel for schedule(static)
+    if(n>=PARTICLES_PAR_MIN) nth=omp_get_max_threads();
     #endif
-    for(int i=0;i<MAX_PARTICLES;i++){
-        Particle* p=&gParticles[i];
-        if(!p->alive) continue;
-        p->life-=(float)dt; if(p->life<=0.f){ p->alive=FALSE; continue; }
-        p->vy+=G*0.35f*(float)dt;
-        p->vx*=(1.0f-0.035f*(float)dt);
-        p->x+=p->vx*(float)dt;
-        p->y+=p->vy*(float)dt;
-        if(p->y>gy){ p->y=gy; p->vy=-p->vy*0.30f; p->vx*=0.84f; if(fabsf(p->vy)<16.f) p->vy=0; }
+    int offs[257]={0};
+    if(nth>256) nth=256;
+
+    if(tareas){
+        #ifdef _OPENMP
+        #pragma omp taskloop grainsize(1) shared(offs)
+        #endif
+        for(int t=0;t<nth;t++){
+            int lo=(int)((long long)n*t/nth), hi=(int)((long long)n*(t+1)/nth);
+            offs[t+1]=ParticlesAvanzar(A,lo,hi,fdt,gy);
+        }
+        for(int k=0;k<nth;k++) offs[k+1]+=offs[k];
+        B->n=offs[nth];
+        #ifdef _OPENMP
+        #pragma omp taskloop grainsize(1) shared(offs)
+        #endif
+        for(int t=0;t<nth;t++){
+            int lo=(int)((long long)n*t/nth), hi=(int)((long long)n*(t+1)/nth);
+            ParticlesCompactar(A,B,lo,hi,offs[t]);
+        }
+    } else {
+        #ifdef _OPENMP
+        #pragma omp parallel num_threads(nth)
+        #endif
+        {
+            int t=0, nt=1;
+            #ifdef _OPENMP
+            t=omp_get_thread_num(); nt=omp_get_num_threads();
+            #endif
+            int lo=(int)((long long)n*t/nt), hi=(int)((long long)n*(t+1)/nt);
+            offs[t+1]=ParticlesAvanzar(A,lo,hi,fdt,gy);
+            #ifdef _OPENMP
+            #pragma omp barrier
+            #pragma omp single
+            #endif
+            { for(int k=0;k<nt;k++) offs[k+1]+=offs[k]; B->n=offs[nt]; }
+            ParticlesCompactar(A,B,lo,hi,offs[t]);
+        }
     }
+    A->n=0; gCur^=1;
 #else
-    (void)dt;
+    (void)dt; (void)tareas;
 #endif
 }
 
@@ -175,14 +350,13 @@ static void ParticlesDraw(){
 #if ENABLE_SPARKS
     HPEN oldPen=(HPEN)SelectObject(backDC,GetStockObject(NULL_PEN));
     HBRUSH oldBrush=NULL;
-    for(int i=0;i<MAX_PARTICLES;i++){
-        Particle* p=&gParticles[i];
-        if(!p->alive) continue;
-        int s=p->size;
-        float t=p->life/(p->maxLife+1e-6f);
+    const Particles* P=&gPart[gCur];
+    for(int i=0;i<P->n;i++){
+        int s=P->size[i];
+        float t=P->life[i]/(P->maxLife[i]+1e-6f);
         s=(int)(s*clampf(0.5f+t,0.5f,1.0f)); if(s<=0) s=1;
-        int x=(int)p->x - s/2, y=(int)p->y - s/2;
-        oldBrush=(HBRUSH)SelectObject(backDC,p->brush);
+        int x=(int)P->x[i] - s/2, y=(int)P->y[i] - s/2;
+        oldBrush=(HBRUSH)SelectObject(backDC,P->brush[i]);
         Ellipse(backDC,x,y,x+s,y+s);
     }
     if(oldBrush) SelectObject(backDC,oldBrush);
@@ -190,28 +364,38 @@ static void ParticlesDraw(){
 #endif
 }
 
-/* Activación de bola (genera estado inicial y pinceles) */
+/* Historia de estela vacía, toda en la posición actual de la bola i */
+static void SeedTrail(int i){
+    if(!trails) return;
+    Ball* b=&balls[i]; Trail* t=&trails[i];
+    t->count=0; for(int j=0;j<TRAIL_LEN;j++){ t->x[j]=b->x+b->r; t->y[j]=b->y+b->r; }
+}
+
+/* Activación de bola (genera estado inicial y toma sus pinceles de la
+   paleta); solo usa el RNG de la bola, así que corre dentro del lazo
+   paralelo de la física */
 static void ActivateBall(Ball* b){
-    int r=MIN_R+rand()%(MAX_R-MIN_R+1);
+    uint32_t* g=&b->rng;
+    int r=irand_range(g,MIN_R,MAX_R);
     b->r=r;
-    b->x=(float)(-2*r - (rand()%60));
-    float startY=GroundY()-(float)(height*0.48f + rand()%(height/7));
+    b->x=(float)(-2*r - irand_range(g,0,59));
+    float startY=GroundY()-(float)(height*0.48f + irand_range(g,0,height/7-1));
     if(startY<0) startY=0;
     b->y=startY - r;
-    b->vx=350.0f + (float)(rand()%210);
-    b->vy=-(640.0f + (float)(rand()%360));
-    b->color=RGB(rand()%200+40,rand()%200+40,rand()%200+40);
-    MakeBrushes(b);
+    b->vx=350.0f + (float)irand_range(g,0,209);
+    b->vy=-(640.0f + (float)irand_range(g,0,359));
+    int cr=irand_range(g,0,PALETA_NIVELES-1), cg=irand_range(g,0,PALETA_NIVELES-1), cb=irand_range(g,0,PALETA_NIVELES-1);
+    int k=(cr*PALETA_NIVELES+cg)*PALETA_NIVELES+cb;
+    b->color=RGB(PaletaNivel(cr),PaletaNivel(cg),PaletaNivel(cb));
+    b->brush=gPaleta[k]; b->shadow=gPaletaSombra[k];
     b->active=TRUE;
-    b->angle=(float)((rand()%360)*3.14159265/180.0);
+    b->angle=(float)(irand_range(g,0,359)*3.14159265/180.0);
     b->angVel=0.0f;
     b->squash=1.0f;
-    b->phase=(float)((rand()%628)/100.0f);
-    b->liftCoeff=0.00055f + 0.00035f*((float)(rand()%100)/100.f);
-    b->jitterT=(float)(rand()%1000)/1000.f;
-#if ENABLE_TRAILS
-    b->trailCount=0; for(int j=0;j<TRAIL_LEN;j++){ b->trailX[j]=b->x+b->r; b->trailY[j]=b->y+b->r; }
-#endif
+    b->phase=(float)(irand_range(g,0,627)/100.0f);
+    b->liftCoeff=0.00055f + 0.00035f*((float)irand_range(g,0,99)/100.f);
+    b->jitterT=(float)irand_range(g,0,999)/1000.f;
+    SeedTrail((int)(b-balls));
 }
 
 /* Desactiva y reprograma la bola (serial) */
@@ -226,30 +410,63 @@ static void ScheduleBallSerial(Ball* b){
 }
 
 /* Desactiva y reprograma la bola (seguro en paralelo) */
-static void ScheduleBallSafe(Ball* b, float gy){
-    if(gPortalBrush){
+static void ScheduleBallSafe(Ball* b, float gy, int sparks){
+    if(sparks && gPortalBrush){
         float cy=b->y+b->r;
         BOOL onFloor=fabsf(cy-gy)<2.0f;
         if(onFloor) SpawnSparks(b->x+b->r,gy,18,gPortalBrush,b->vx);
     }
     b->active=FALSE;
-    b->spawnAt=gTime + NextIntervalSafe();
+    b->spawnAt=gTime + NextIntervalRNG(&b->rng);
 }
 
-/* Inicializa arreglo de bolas y partículas */
-static void InitBalls(){
+/* Inicializa arreglo de bolas y partículas; FALSE si no hay memoria (con
+   MAX_N bolas son decenas de MB más la historia de estela) */
+static BOOL InitBalls(){
     FreeBalls();
     balls=(Ball*)calloc(N,sizeof(Ball));
-    srand((unsigned)time(NULL));
+    trails=gLod? NULL : (Trail*)calloc(N,sizeof(Trail));
+    if(!balls || (!gLod && !trails)){
+        fprintf(stderr,"sin memoria para %d bolas\n",N);
+        FreeBalls();
+        return FALSE;
+    }
+    MakePalette();
+    uint32_t base=(uint32_t)time(NULL);
+    srand(base);
     if(!gPortalBrush) gPortalBrush=CreateSolidBrush(RGB(120,160,255));
-    double t=0.0;
+    double t=0.0, esc=gLod? LOD_LLENADO_S/(0.126*N) : 1.0;
     for(int i=0;i<N;i++){
         balls[i].active=FALSE;
         balls[i].spawnAt=t;
         balls[i].squash=1.0f;
-        t+=0.09 + (rand()%10)*0.008;
+        balls[i].rng=base ^ (0x9E3779B9u*(uint32_t)(i+1));
+        t+=(0.09 + (rand()%10)*0.008)*esc;
     }
     ParticlesClear();
+    return TRUE;
+}
+
+/* DIB de 32 bits top-down cuyos píxeles quedan accesibles como memoria */
+static HBITMAP CreateDIB32(HDC dc,int w,int h,unsigned int** bits){
+    BITMAPINFO bi; memset(&bi,0,sizeof(bi));
+    bi.bmiHeader.biSize=sizeof(BITMAPINFOHEADER);
+    bi.bmiHeader.biWidth=w; bi.bmiHeader.biHeight=-h;
+    bi.bmiHeader.biPlanes=1; bi.bmiHeader.biBitCount=32; bi.bmiHeader.biCompression=BI_RGB;
+    *bits=NULL;
+    HBITMAP bmp=CreateDIBSection(dc,&bi,DIB_RGB_COLORS,(void**)bits,NULL,0);
+    if(bmp && !*bits){ DeleteObject(bmp); bmp=NULL; }
+    return bmp;
+}
+
+/* Capa de estela: DIB de 32 bits con alfa */
+static void InitTrailLayer(HDC dc,int w,int h){
+    if(trailDC){ SelectObject(trailDC,trailOld); DeleteObject(trailBMP); DeleteDC(trailDC); trailDC=NULL; trailBMP=NULL; trailOld=NULL; trailBits=NULL; }
+    trailBMP=CreateDIB32(dc,w,h,&trailBits);
+    if(!trailBMP) return;
+    trailDC=CreateCompatibleDC(dc);
+    trailOld=(HBITMAP)SelectObject(trailDC,trailBMP);
+    memset(trailBits,0,(size_t)w*h*4);
 }
 
 /* Backbuffer para dibujo sin flicker */
@@ -258,6 +475,17 @@ static void InitBackBuffer(HDC wndDC,int w,int h){
     backDC=CreateCompatibleDC(wndDC);
     backBMP=CreateCompatibleBitmap(wndDC,w,h);
     backOld=(HBITMAP)SelectObject(backDC,backBMP);
+    InitTrailLayer(wndDC,w,h);
+}
+
+/* Backbuffer sin ventana: DIB en memoria para leer cada cuadro terminado */
+static BOOL InitOffscreen(int w,int h){
+    backBMP=CreateDIB32(NULL,w,h,&backBits);
+    if(!backBMP) return FALSE;
+    backDC=CreateCompatibleDC(NULL);
+    backOld=(HBITMAP)SelectObject(backDC,backBMP);
+    InitTrailLayer(NULL,w,h);
+    return TRUE;
 }
 
 /* Fondo y “piso” */
@@ -315,36 +543,190 @@ static void DrawBallWithEffects(Ball* b){
 }
 
 /* Estela simple */
-static void DrawTrails(Ball* b){
+static void DrawTrails(Ball* b,const Trail* tr){
 #if ENABLE_TRAILS
     HBRUSH oldBrush=(HBRUSH)SelectObject(backDC,b->shadow);
     HPEN oldPen=(HPEN)SelectObject(backDC,GetStockObject(NULL_PEN));
     int r=b->r;
-    int steps=b->trailCount;
+    int steps=tr->count;
     for(int k=1;k<steps && k<TRAIL_LEN;k++){
         float t=(float)k/(float)TRAIL_LEN;
         int rr=(int)(r*(0.42f*(1.0f-t)+0.12f)); if(rr<1) rr=1;
-        int x=(int)b->trailX[k]-rr;
-        int y=(int)b->trailY[k]-rr;
+        int x=(int)tr->x[k]-rr;
+        int y=(int)tr->y[k]-rr;
         Ellipse(backDC,x,y,x+2*rr,y+2*rr);
     }
     SelectObject(backDC,oldPen);
     SelectObject(backDC,oldBrush);
 #else
-    (void)b;
+    (void)b; (void)tr;
 #endif
 }
 
-/* Dibuja todas las bolas activas */
-static void DrawBalls(int* outActive){
+#if ENABLE_TRAILS
+/* Estela acumulada: desvanece toda la capa (premultiplicada, así que basta
+   escalar los 4 canales) con un recorrido vectorizable sobre los bytes. El
+   grafo de tareas la reparte en tramos con TrailLayerFadeRango. */
+#define TRAIL_FADE_PAR_MIN (1<<18)
+static void TrailLayerFadeRango(long long lo,long long hi){
+    unsigned char* p=(unsigned char*)trailBits;
+    #ifdef _OPENMP
+    #pragma omp simd
+    #endif
+    for(long long i=lo;i<hi;i++) p[i]=(unsigned char)((p[i]*TRAIL_FADE_Q8)>>8);
+}
+
+static void TrailLayerFade(){
+    unsigned char* p=(unsigned char*)trailBits;
+    const long long n=(long long)width*height*4;
+    GdiFlush();
+    #ifdef _OPENMP
+    #pragma omp parallel for simd schedule(static) if(n>=TRAIL_FADE_PAR_MIN)
+    #endif
+    for(long long i=0;i<n;i++) p[i]=(unsigned char)((p[i]*TRAIL_FADE_Q8)>>8);
+}
+
+/* Estampa solo la posición actual de la bola: disco opaco del color de sombra */
+static void TrailLayerStamp(const Ball* b){
+    COLORREF c=Darken(b->color,75);
+    unsigned int px=0xFF000000u | ((unsigned)GetRValue(c)<<16) | ((unsigned)GetGValue(c)<<8) | (unsigned)GetBValue(c);
+    int rr=(int)(b->r*0.50f); if(rr<1) rr=1;
+    int cx=(int)(b->x+b->r), cy=(int)(b->y+b->r);
+    if(cy+rr<0 || cy-rr>=height) return;
+    int y0=clampi(cy-rr,0,height-1), y1=clampi(cy+rr,0,height-1);
+    for(int y=y0;y<=y1;y++){
+        int dy=y-cy, dx=(int)sqrtf((float)(rr*rr-dy*dy));
+        int x0=cx-dx, x1=cx+dx;
+        if(x0<0) x0=0;
+        if(x1>width-1) x1=width-1;
+        unsigned int* row=trailBits+(size_t)y*width;
+        for(int x=x0;x<=x1;x++) row[x]=px;
+    }
+}
+
+/* Estampa las bolas activas y compone con AlphaBlend (ya desvanecida) */
+static void TrailLayerCompose(){
+    for(int i=0;i<N;i++) if(balls[i].active) TrailLayerStamp(&balls[i]);
+    BLENDFUNCTION bf={AC_SRC_OVER,0,255,AC_SRC_ALPHA};
+    AlphaBlend(backDC,0,0,width,height,trailDC,0,0,width,height,bf);
+}
+
+/* Costo O(pixeles + N): desvanecer, estampar y componer con AlphaBlend */
+static void DrawTrailLayer(){
+    if(!trailBits) return;
+    TrailLayerFade();
+    TrailLayerCompose();
+}
+#endif
+
+/* Capa LOD y rejillas de acumulación del tamaño actual */
+static void FreeLodLayer(){
+    if(lodDC){ SelectObject(lodDC,lodOld); DeleteObject(lodBMP); DeleteDC(lodDC); lodDC=NULL; lodBMP=NULL; lodOld=NULL; lodBits=NULL; }
+    free(lodCnt); free(lodVel); lodCnt=NULL; lodVel=NULL; lodW=lodH=0;
+}
+
+static void InitLodLayer(int w,int h){
+    FreeLodLayer();
+    lodBMP=CreateDIB32(backDC,w,h,&lodBits);
+    lodCnt=(unsigned int*)calloc((size_t)w*h,sizeof(unsigned int));
+    lodVel=(float*)calloc((size_t)w*h,sizeof(float));
+    if(!lodBMP || !lodCnt || !lodVel){ FreeLodLayer(); return; }
+    lodDC=CreateCompatibleDC(backDC);
+    lodOld=(HBITMAP)SelectObject(lodDC,lodBMP);
+    lodW=w; lodH=h;
+}
+
+/* Mapa de densidad: splat paralelo O(N) con sumas atómicas (los choques
+   por píxel son raros), luego una pasada O(píxeles) que mapea log(conteo)
+   a alfa y rapidez media a tinte frío->cálido y de paso limpia la rejilla */
+static void DrawDensity(int* outActive){
+    if(lodW!=width || lodH!=height) InitLodLayer(width,height);
     int active=0;
+    if(!lodBits){ if(outActive) *outActive=0; return; }
+    const int w=width, h=height;
+    const long long np=(long long)w*h;
+    unsigned int cmax=0;
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(static) reduction(+:active) reduction(max:cmax)
+    #endif
     for(int i=0;i<N;i++){
+        const Ball* b=&balls[i];
+        if(!b->active) continue;
+        active++;
+        int x=(int)(b->x+b->r), y=(int)(b->y+b->r);
+        if((unsigned)x>=(unsigned)w || (unsigned)y>=(unsigned)h) continue;
+        size_t p=(size_t)y*w+x;
+        float v=fabsf(b->vx)+fabsf(b->vy);
+        unsigned int c;
+        #ifdef _OPENMP
+        #pragma omp atomic capture
+        #endif
+        c=++lodCnt[p];
+        #ifdef _OPENMP
+        #pragma omp atomic
+        #endif
+        lodVel[p]+=v;
+        if(c>cmax) cmax=c;
+    }
+
+    const float inv=cmax? 1.0f/logf(1.0f+(float)cmax) : 0.0f;
+    GdiFlush();
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(static) if(np>=(1<<16))
+    #endif
+    for(long long p=0;p<np;p++){
+        unsigned int c=lodCnt[p];
+        if(!c){ lodBits[p]=0; continue; }
+        float a=0.35f+0.65f*logf(1.0f+(float)c)*inv;
+        float s=clampf(lodVel[p]/((float)c*LOD_VEL_REF),0.0f,1.0f);
+        unsigned int A=(unsigned int)(a*255.0f);
+        unsigned int R=(unsigned int)((80.0f+175.0f*s)*a);
+        unsigned int Gc=(unsigned int)((150.0f+20.0f*s)*a);
+        unsigned int B=(unsigned int)((255.0f-195.0f*s)*a);
+        lodBits[p]=(A<<24)|(R<<16)|(Gc<<8)|B;
+        lodCnt[p]=0; lodVel[p]=0.0f;
+    }
+    BLENDFUNCTION bf={AC_SRC_OVER,0,255,AC_SRC_ALPHA};
+    AlphaBlend(backDC,0,0,w,h,lodDC,0,0,w,h,bf);
+
+    for(int i=0;i<N;i+=gLodPaso) if(balls[i].active && balls[i].brush) DrawBallWithEffects(&balls[i]);
+    if(outActive) *outActive=active;
+}
+
+/* Estela acumulada activa (se compone antes de las bolas) */
+static BOOL TrailAcum(){
+#if ENABLE_TRAILS
+    return (gFx&FX_TRAILS) && gTrailMode==TRAIL_ACUM && trailBits;
+#else
+    return FALSE;
+#endif
+}
+
+/* Dibuja las bolas activas de [lo,hi); devuelve cuántas había */
+static int DrawBallRange(int lo,int hi){
+    int active=0;
+#if ENABLE_TRAILS
+    BOOL puntos=(gFx&FX_TRAILS) && !TrailAcum() && trails;
+#endif
+    for(int i=lo;i<hi;i++){
         Ball* b=&balls[i];
         if(!b->active) continue;
         active++;
-        DrawTrails(b);
+#if ENABLE_TRAILS
+        if(puntos) DrawTrails(b,&trails[i]);
+#endif
         DrawBallWithEffects(b);
     }
+    return active;
+}
+
+/* Dibuja todas las bolas activas */
+static void DrawBalls(int* outActive){
+    if(gLod){ DrawDensity(outActive); return; }
+#if ENABLE_TRAILS
+    if(TrailAcum()) DrawTrailLayer();
+#endif
+    int active=DrawBallRange(0,N);
     if(outActive) *outActive=active;
 }
 
@@ -353,104 +735,338 @@ static void DrawHUD(double fps,int active){
     SetBkMode(backDC,TRANSPARENT);
     SetTextColor(backDC,RGB(240,240,240));
     char buf[128];
-    sprintf(buf,"FPS: %.1f   Activas: %d/%d",fps,active,N);
+    if(gLod) sprintf(buf,"FPS: %.1f   Activas: %d/%d   Densidad (sprites 1/%d)",fps,active,N,gLodPaso);
+    else sprintf(buf,"FPS: %.1f   Activas: %d/%d   Estela: %s [T]",fps,active,N,gTrailMode==TRAIL_ACUM?"acumulada":"puntos");
     TextOutA(backDC,8,8,buf,lstrlenA(buf));
 }
 
 /* Presenta el backbuffer */
 static void Present(HDC wndDC){ BitBlt(wndDC,0,0,width,height,backDC,0,0,SRCCOPY); }
 
-/* Física: activa bolas (serial) y actualiza en paralelo; partículas también en paralelo */
-static void UpdatePhysics(double dt){
-    dt*=TIME_SCALE;
-    float gy=GroundY();
-
-    for(int i=0;i<N;i++){ if(!balls[i].active && gTime>=balls[i].spawnAt) ActivateBall(&balls[i]); }
-
-    #ifdef _OPENMP
-    #pragma omp parallel for schedule(static)
-    #endif
-    for(int i=0;i<N;i++){
-        Ball* b=&balls[i];
-        if(!b->active) continue;
-
-        int r=b->r;
-        float prevVy=b->vy;
+/* Núcleo por bola, especializado en compilación: TRAILS/SPARKS/WIND/JITTER
+   llegan como constantes literales, así cada variante pierde las ramas y
+   el trabajo de los efectos apagados. */
+static FORCE_INLINE void UpdateBallT(Ball* b,int i,double dt,float gy,
+                                     const int TRAILS,const int SPARKS,const int WIND,const int JITTER){
+    int r=b->r;
+    float prevVy=b->vy;
 
+    if(WIND){
         float wind = 70.0f*sinf((float)(1.10*gTime + b->phase)) + 35.0f*sinf((float)(0.63*gTime + i*0.19f));
         b->vx += wind*(float)dt;
+    }
 
-        float lift = b->liftCoeff * b->angVel * b->vx;
-        b->vy += (G + lift)*(float)dt;
-        b->vx *= (1.0f - AIR * (float)dt);
+    float lift = b->liftCoeff * b->angVel * b->vx;
+    b->vy += (G + lift)*(float)dt;
+    b->vx *= (1.0f - AIR * (float)dt);
 
-        b->x += b->vx*(float)dt;
-        b->y += b->vy*(float)dt;
+    b->x += b->vx*(float)dt;
+    b->y += b->vy*(float)dt;
 
-        float cy=b->y+r;
-        if(cy + r > gy){
-            float impact=fabsf(prevVy);
-            b->y=gy-r;
-            b->vy=-b->vy*REST;
-            b->vx*=GROUND_FRICTION;
-            if(fabsf(b->vy)<60.f) b->vy=0.f;
+    float cy=b->y+r;
+    if(cy + r > gy){
+        float impact=fabsf(prevVy);
+        b->y=gy-r;
+        b->vy=-b->vy*REST;
+        b->vx*=GROUND_FRICTION;
+        if(fabsf(b->vy)<60.f) b->vy=0.f;
 
-            b->squash=clampf(1.0f + impact/850.0f,1.0f,1.95f);
-            b->angVel += (b->vx/(float)(r))*0.35f;
+        b->squash=clampf(1.0f + impact/850.0f,1.0f,1.95f);
+        b->angVel += (b->vx/(float)(r))*0.35f;
 
-            if(impact>300.f){
-                int cnt=8+(int)(impact/220.f); if(cnt>28) cnt=28;
-                SpawnSparks(b->x+r,gy,cnt,b->shadow,b->vx);
-            }
-            {
-                int toss = rand_inclusive_safe(0,3);
-                if(fabsf(b->vx)>420.f && fabsf(b->vy)<30.f && (toss==0)){
-                    float extra = 420.f + (float)rand_inclusive_safe(0,179);
-                    b->vy -= extra;
-                }
-            }
+        if(SPARKS && impact>300.f){
+            int cnt=8+(int)(impact/220.f); if(cnt>28) cnt=28;
+            SpawnSparks(b->x+r,gy,cnt,b->shadow,b->vx);
         }
+        /* El sorteo solo se gasta si la bola rueda rápido */
+        if(fabsf(b->vx)>420.f && fabsf(b->vy)<30.f && irand_range(&b->rng,0,3)==0)
+            b->vy -= 420.f + (float)irand_range(&b->rng,0,179);
+    }
 
-        if(b->y<0){ b->y=0; b->vy=-b->vy*WALL_DAMP; }
-        if(b->x< -2*r){ b->x= -2*r; b->vx = fabsf(b->vx)*0.95f; }
-        if(b->x + 2*r > width){
-            b->x = width - 2*r;
-            b->vx = -fabsf(b->vx)*0.75f;
-            b->angVel *= 0.85f;
-            SpawnSparks(b->x+2*r,cy,b->vy>0?10:6,b->shadow,-b->vx);
-        }
+    if(b->y<0){ b->y=0; b->vy=-b->vy*WALL_DAMP; }
+    if(b->x< -2*r){ b->x= -2*r; b->vx = fabsf(b->vx)*0.95f; }
+    if(b->x + 2*r > width){
+        b->x = width - 2*r;
+        b->vx = -fabsf(b->vx)*0.75f;
+        b->angVel *= 0.85f;
+        if(SPARKS) SpawnSparks(b->x+2*r,cy,b->vy>0?10:6,b->shadow,-b->vx);
+    }
 
-        b->squash += (1.0f - b->squash)*(float)(9.0*dt);
-        if(fabsf(b->squash-1.0f)<0.01f) b->squash=1.0f;
+    b->squash += (1.0f - b->squash)*(float)(9.0*dt);
+    if(fabsf(b->squash-1.0f)<0.01f) b->squash=1.0f;
 
-        b->angVel *= (1.0f - 0.26f * (float)dt);
-        b->angle  += b->angVel*(float)dt;
+    b->angVel *= (1.0f - 0.26f * (float)dt);
+    b->angle  += b->angVel*(float)dt;
 
+    if(JITTER){
         b->jitterT += (float)dt;
         if(b->jitterT>0.08f){
             b->jitterT=0.f;
-            int dx = rand_inclusive_safe(-100,100);
+            int dx = irand_range(&b->rng,-100,100);
             b->vx += (float)dx * 0.6f;
-            int r6 = rand_inclusive_safe(0,5);
+            int r6 = irand_range(&b->rng,0,5);
             if(r6==0){
-                int da = rand_inclusive_safe(-100,100);
+                int da = irand_range(&b->rng,-100,100);
                 b->angVel += ((float)da/100.f)*0.9f;
             }
         }
+    }
 
-        BOOL onFloor=fabsf((b->y+r)-gy)<1.0f;
-        BOOL nearRight=(b->x + 2*r)>(RIGHT_ZONE*width);
-        BOOL quiet=fabsf(b->vx)<QUIET_VX && fabsf(b->vy)<QUIET_VY;
-        if(onFloor && nearRight && quiet){ ScheduleBallSafe(b, gy); continue; }
-        if(b->x - 2*r > width+20){ ScheduleBallSafe(b, gy); continue; }
+    BOOL onFloor=fabsf((b->y+r)-gy)<1.0f;
+    BOOL nearRight=(b->x + 2*r)>(RIGHT_ZONE*width);
+    BOOL quiet=fabsf(b->vx)<QUIET_VX && fabsf(b->vy)<QUIET_VY;
+    if(onFloor && nearRight && quiet){ ScheduleBallSafe(b, gy, SPARKS); return; }
+    if(b->x - 2*r > width+20){ ScheduleBallSafe(b, gy, SPARKS); return; }
 
 #if ENABLE_TRAILS
-        for(int k=TRAIL_LEN-1;k>0;k--){ b->trailX[k]=b->trailX[k-1]; b->trailY[k]=b->trailY[k-1]; }
-        b->trailX[0]=b->x+r; b->trailY[0]=b->y+r; if(b->trailCount<TRAIL_LEN) b->trailCount++;
+    if(TRAILS){
+        Trail* t=&trails[i];
+        for(int k=TRAIL_LEN-1;k>0;k--){ t->x[k]=t->x[k-1]; t->y[k]=t->y[k-1]; }
+        t->x[0]=b->x+r; t->y[0]=b->y+r; if(t->count<TRAIL_LEN) t->count++;
+    }
 #endif
+}
+
+/* Una variante por combinación de efectos; se elige una vez en SelectBallKernel */
+typedef void (*BallKernel)(double dt,float gy,int lo,int hi);
+#define BALL_KERNEL(T,S,W,J) \
+    static void UpdateBalls_##T##S##W##J(double dt,float gy,int lo,int hi){ \
+        OMP_PARALLEL_FOR \
+        for(int i=lo;i<hi;i++){ \
+            Ball* b=&balls[i]; \
+            if(!b->active){ if(gTime<b->spawnAt) continue; ActivateBall(b); } \
+            UpdateBallT(b,i,dt,gy,T,S,W,J); \
+        } \
     }
+BALL_KERNEL(0,0,0,0) BALL_KERNEL(1,0,0,0) BALL_KERNEL(0,1,0,0) BALL_KERNEL(1,1,0,0)
+BALL_KERNEL(0,0,1,0) BALL_KERNEL(1,0,1,0) BALL_KERNEL(0,1,1,0) BALL_KERNEL(1,1,1,0)
+BALL_KERNEL(0,0,0,1) BALL_KERNEL(1,0,0,1) BALL_KERNEL(0,1,0,1) BALL_KERNEL(1,1,0,1)
+BALL_KERNEL(0,0,1,1) BALL_KERNEL(1,0,1,1) BALL_KERNEL(0,1,1,1) BALL_KERNEL(1,1,1,1)
+static const BallKernel gBallKernels[16]={
+    UpdateBalls_0000,UpdateBalls_1000,UpdateBalls_0100,UpdateBalls_1100,
+    UpdateBalls_0010,UpdateBalls_1010,UpdateBalls_0110,UpdateBalls_1110,
+    UpdateBalls_0001,UpdateBalls_1001,UpdateBalls_0101,UpdateBalls_1101,
+    UpdateBalls_0011,UpdateBalls_1011,UpdateBalls_0111,UpdateBalls_1111
+};
+static BallKernel gBallKernel=UpdateBalls_1111;
+
+/* Elige la variante según gFx; el desplazamiento del historial solo hace
+   falta con estela de puntos (la capa acumulada usa la posición actual) */
+static void SelectBallKernel(){
+    int t=(gFx&FX_TRAILS) && gTrailMode==TRAIL_PUNTOS;
+    int idx=t | ((gFx&FX_SPARKS)?2:0) | ((gFx&FX_WIND)?4:0) | ((gFx&FX_JITTER)?8:0);
+    gBallKernel=gBallKernels[idx];
+}
+
+/* Física: activa y actualiza bolas en paralelo (el kernel activa las que ya
+   cumplieron su espera); partículas también en paralelo */
+static void UpdatePhysics(double dt){
+    dt*=TIME_SCALE;
+    float gy=GroundY();
+
+    gBallKernel(dt,gy,0,N);
 
-    ParticlesUpdate(dt);
+    if(gFx&FX_SPARKS) ParticlesUpdate(dt,FALSE);
+}
+
+/* ===== Línea de tiempo por cuadro (-linea_tiempo archivo.csv) =====
+   Cada fase o tarea anota [ini,fin) y el hilo que la corrió; al cerrar el
+   cuadro se acumulan pared, trabajo y solapamientos, y si hay archivo se
+   escribe una fila por tarea (ms desde el inicio del cuadro). */
+#define LT_MAX 256
+typedef struct { const char* nombre; int bloque, hilo; double ini, fin; } LtTarea;
+static struct {
+    FILE* f; int cuadro, n; double t0;
+    LtTarea v[LT_MAX];
+    double pared, trabajo, fondo, fondoSolapado; int temprano, conDibujo;
+} gLt;
+
+static double LtAhora(){
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    LARGE_INTEGER t,f; QueryPerformanceCounter(&t); QueryPerformanceFrequency(&f);
+    return (double)t.QuadPart/(double)f.QuadPart;
+#endif
+}
+
+static void LtMarca(const char* nombre,int bloque,double ini,double fin){
+    if(!gLt.f) return;
+    int i;
+    #ifdef _OPENMP
+    #pragma omp atomic capture
+    #endif
+    i=gLt.n++;
+    if(i>=LT_MAX) return;
+    int hilo=0;
+    #ifdef _OPENMP
+    hilo=omp_get_thread_num();
+    #endif
+    LtTarea t={nombre,bloque,hilo,ini,fin};
+    gLt.v[i]=t;
+}
+
+static void LtInicioCuadro(){ gLt.n=0; gLt.t0=LtAhora(); }
+
+static double Solape(double a0,double a1,double b0,double b1){ double x=(a1<b1?a1:b1)-(a0>b0?a0:b0); return x>0?x:0; }
+
+static void LtFinCuadro(){
+    if(!gLt.f) return;
+    int n=gLt.n<LT_MAX? gLt.n : LT_MAX;
+    double fin=gLt.t0, trabajo=0, finFisica=gLt.t0, iniDibujo=1e300;
+    const LtTarea* fondo=NULL;
+    for(int i=0;i<n;i++){
+        const LtTarea* t=&gLt.v[i];
+        if(t->fin>fin) fin=t->fin;
+        trabajo+=t->fin-t->ini;
+        if(!strcmp(t->nombre,"fisica") && t->fin>finFisica) finFisica=t->fin;
+        if(!strcmp(t->nombre,"dibujo") && t->ini<iniDibujo) iniDibujo=t->ini;
+        if(!strcmp(t->nombre,"fondo")) fondo=t;
+        fprintf(gLt.f,"%d,%s,%d,%d,%.4f,%.4f\n",gLt.cuadro,t->nombre,t->bloque,t->hilo,
+                (t->ini-gLt.t0)*1e3,(t->fin-gLt.t0)*1e3);
+    }
+    if(fondo){
+        double s=0, len=fondo->fin-fondo->ini;
+        for(int i=0;i<n;i++) if(!strcmp(gLt.v[i].nombre,"fisica")) s+=Solape(fondo->ini,fondo->fin,gLt.v[i].ini,gLt.v[i].fin);
+        gLt.fondo+=len; gLt.fondoSolapado+=s<len? s : len;
+    }
+    if(iniDibujo<1e300){ gLt.conDibujo++; if(iniDibujo<finFisica) gLt.temprano++; }
+    gLt.pared+=fin-gLt.t0; gLt.trabajo+=trabajo;
+    gLt.cuadro++;
+}
+
+/* Resumen: paralelismo medio = trabajo/pared; fondo solapado = parte del
+   fondo que corrió junto a física; dibujo temprano = cuadros en que alguna
+   bola se dibujó antes de terminar toda la física */
+static void LtResumen(FILE* out,const char* pre){
+    if(!gLt.cuadro) return;
+    fprintf(out,"%scuadros=%d pared=%.3f ms trabajo=%.3f ms paralelismo=%.2f fondo_solapado=%.0f%% dibujo_temprano=%.0f%%\n",
+            pre,gLt.cuadro,gLt.pared*1e3/gLt.cuadro,gLt.trabajo*1e3/gLt.cuadro,
+            gLt.pared>0? gLt.trabajo/gLt.pared : 0.0,
+            gLt.fondo>0? 100.0*gLt.fondoSolapado/gLt.fondo : 0.0,
+            gLt.conDibujo? 100.0*gLt.temprano/gLt.conDibujo : 0.0);
+}
+
+static BOOL LtAbrir(const char* ruta){
+    char p[MAX_PATH]={0}; sscanf(ruta,"%259s",p);
+    gLt.f=fopen(p,"w");
+    if(gLt.f) fprintf(gLt.f,"cuadro,tarea,bloque,hilo,ini_ms,fin_ms\n");
+    return gLt.f!=NULL;
+}
+static void LtCerrar(){
+    if(!gLt.f) return;
+    LtResumen(gLt.f,"# ");
+    fclose(gLt.f); gLt.f=NULL;
+}
+
+/* ===== Cuadro como grafo de tareas =====
+   La física se parte en bloques de bolas; los dibujos GDI (un solo DC) van en
+   cadena sobre el testigo 'gdi' y cada bloque se dibuja en cuanto su física
+   termina, mientras otros bloques siguen integrando. El fondo no depende de la
+   física y corre junto a ella. Las chispas se actualizan cuando ya no puede
+   llegar ninguna (inout sobre 'fisica' espera a todas las tareas con in). Cada
+   tarea GDI termina con GdiFlush: el lote de GDI es por hilo y otro hilo
+   podría dibujar antes de que se vacíe.
+   Dentro de una tarea un parallel anidado corre con un hilo, así que el
+   reparto sale de las tareas: unos BLOQUES_POR_HILO bloques por hilo (aun con
+   N chico), y el desvanecido de la estela y las chispas van como taskloop. El
+   desvanecido no toca bolas y corre junto a la física. Con un solo hilo el
+   grafo no tiene qué solapar y se usa el cuadro por fases. */
+static BOOL gGrafo=TRUE;                 /* -secuencial vuelve al cuadro por fases */
+#define BLOQUE_MIN 8
+#define BLOQUES_POR_HILO 4
+#define MAX_BLOQUES 64
+
+#ifdef _OPENMP
+static int FrameGrafo(double dt,double fps){
+    dt*=TIME_SCALE;
+    const float gy=GroundY();
+    const int nth=omp_get_max_threads();
+    const int nk=clampi(N/BLOQUE_MIN,1,clampi(BLOQUES_POR_HILO*nth,1,MAX_BLOQUES)), paso=(N+nk-1)/nk;
+    const BOOL acum=TrailAcum(), sparks=(gFx&FX_SPARKS)!=0;
+    int active=0;
+    char fisica=0, gdi=0, part=0, capa=0, fis[MAX_BLOQUES];
+
+    #pragma omp parallel
+    #pragma omp single
+    {
+        #pragma omp task depend(out:gdi)
+        { double t=LtAhora(); DrawBackground(); GdiFlush(); LtMarca("fondo",-1,t,LtAhora()); }
+#if ENABLE_TRAILS
+        if(acum && trailBits){
+            /* el cuadro anterior ya vació sus lotes GDI: la capa se puede tocar */
+            #pragma omp task depend(out:capa)
+            {
+                double t=LtAhora();
+                const long long n=(long long)width*height*4;
+                const int nb=n>=TRAIL_FADE_PAR_MIN? nth : 1;
+                #pragma omp taskloop grainsize(1)
+                for(int k=0;k<nb;k++) TrailLayerFadeRango(n*k/nb,n*(k+1)/nb);
+                LtMarca("estela_fade",-1,t,LtAhora());
+            }
+        }
+#endif
+
+        for(int k=0;k<nk;k++){
+            #pragma omp task depend(in:fisica) depend(out:fis[k])
+            {
+                double t=LtAhora();
+                int lo=k*paso, hi=lo+paso<N? lo+paso : N;
+                gBallKernel(dt,gy,lo,hi);
+                LtMarca("fisica",k,t,LtAhora());
+            }
+        }
+#if ENABLE_TRAILS
+        if(acum){
+            /* la capa estampa todas las bolas: espera a toda la física */
+            #pragma omp task depend(inout:fisica) depend(in:capa) depend(inout:gdi)
+            { double t=LtAhora(); if(trailBits) TrailLayerCompose(); GdiFlush(); LtMarca("estela",-1,t,LtAhora()); }
+        }
+#endif
+        for(int k=0;k<nk;k++){
+            #pragma omp task depend(in:fis[k]) depend(inout:gdi)
+            {
+                double t=LtAhora();
+                int lo=k*paso, hi=lo+paso<N? lo+paso : N;
+                active+=DrawBallRange(lo,hi);
+                GdiFlush();
+                LtMarca("dibujo",k,t,LtAhora());
+            }
+        }
+        if(sparks){
+            #pragma omp task depend(inout:fisica) depend(out:part)
+            { double t=LtAhora(); ParticlesUpdate(dt,TRUE); LtMarca("chispas",-1,t,LtAhora()); }
+            #pragma omp task depend(in:part) depend(inout:gdi)
+            { double t=LtAhora(); ParticlesDraw(); GdiFlush(); LtMarca("chispas_dib",-1,t,LtAhora()); }
+        }
+        #pragma omp task depend(inout:gdi)
+        { double t=LtAhora(); DrawHUD(fps,active); GdiFlush(); LtMarca("hud",-1,t,LtAhora()); }
+    }
+    (void)acum; (void)fisica; (void)gdi; (void)part; (void)capa; (void)fis;   /* solo testigos de dependencia */
+    return active;
+}
+#endif
+
+/* Un cuadro completo sin Present: grafo de tareas o fases en secuencia (que
+   también se anotan en la línea de tiempo para comparar). El modo densidad
+   va siempre por fases: su splat ya es un lazo paralelo; con un solo hilo
+   también, porque el grafo solo agregaría tareas. */
+static int Frame(double dt,double fps){
+    int active=0;
+    LtInicioCuadro();
+#ifdef _OPENMP
+    if(gGrafo && !gLod && omp_get_max_threads()>1) active=FrameGrafo(dt,fps); else
+#endif
+    {
+        double t=LtAhora(), u;
+        UpdatePhysics(dt);                        u=LtAhora(); LtMarca("fisica",-1,t,u); t=u;
+        DrawBackground();                         u=LtAhora(); LtMarca("fondo",-1,t,u); t=u;
+        DrawBalls(&active);                       u=LtAhora(); LtMarca("dibujo",-1,t,u); t=u;
+        if(gFx&FX_SPARKS){ ParticlesDraw();       u=LtAhora(); LtMarca("chispas_dib",-1,t,u); t=u; }
+        DrawHUD(fps,active);                      u=LtAhora(); LtMarca("hud",-1,t,u);
+    }
+    LtFinCuadro();
+    return active;
 }
 
 /* Redimensiona y recrea backbuffer */
@@ -465,12 +1081,328 @@ static void ResizeRecreate(){
 static LRESULT CALLBACK WndProc(HWND h,UINT msg,WPARAM wParam,LPARAM lParam){
     switch(msg){
         case WM_SIZE: ResizeRecreate(); return 0;
+        case WM_KEYDOWN:
+            if(wParam=='T'){
+                gTrailMode^=1;
+                SelectBallKernel();
+                if(trailBits) memset(trailBits,0,(size_t)width*height*4);
+                /* Los kernels de capa no corren la historia: al volver a
+                   puntos se descarta la que quedó de antes del cambio */
+                if(gTrailMode==TRAIL_PUNTOS) for(int i=0;i<N;i++) SeedTrail(i);
+            }
+            return 0;
         case WM_PAINT: { PAINTSTRUCT ps; HDC hdc=BeginPaint(h,&ps); Present(hdc); EndPaint(h,&ps); return 0; }
         case WM_DESTROY: running=FALSE; PostQuitMessage(0); return 0;
     }
     return DefWindowProc(h,msg,wParam,lParam);
 }
 
+/* ===== Render offline: sin ventana ni Sleep, cuadros a codificadores ===== */
+enum { OUT_PPM=0, OUT_Y4M=1, OUT_PNG=2 };
+typedef struct {
+    int frames, w, h, fmt, encoders, queue;
+    char out[MAX_PATH];
+} OfflineCfg;
+
+/* Cola acotada de cuadros: Q buffers que circulan entre el render (llena)
+   y los codificadores (vacían). El render solo espera si no queda buffer
+   libre; para Y4M los codificadores escriben por turno en orden de cuadro. */
+typedef struct {
+    const OfflineCfg* cfg;
+    unsigned char** slot; int* frameDe;
+    unsigned char** tmp; int sigTmp;   /* un buffer de salida por codificador */
+    int* libres; int nLibres;
+    int* listos; int cab, nListos;
+    int fin, sigEscribir, errores;
+    FILE* y4m;
+    CRITICAL_SECTION cs;
+    CONDITION_VARIABLE hayLibre, hayListo, turno;
+} FrameQueue;
+
+/* BGRA -> RGB empacado (P6) */
+static void ToRGB24(const unsigned char* src,unsigned char* dst,int w,int h){
+    for(long long i=0,n=(long long)w*h;i<n;i++){ dst[3*i]=src[4*i+2]; dst[3*i+1]=src[4*i+1]; dst[3*i+2]=src[4*i]; }
+}
+
+/* BGRA -> YUV 4:2:0 planar, BT.601 rango completo (C420jpeg); w y h pares */
+static void ToYUV420(const unsigned char* src,unsigned char* dst,int w,int h){
+    unsigned char *Y=dst, *U=dst+(size_t)w*h, *V=U+(size_t)(w/2)*(h/2);
+    for(int y=0;y<h;y++){
+        const unsigned char* p=src+(size_t)y*w*4;
+        for(int x=0;x<w;x++) Y[(size_t)y*w+x]=(unsigned char)((77*p[4*x+2]+150*p[4*x+1]+29*p[4*x]+128)>>8);
+    }
+    for(int y=0;y<h/2;y++){
+        const unsigned char* p0=src+(size_t)(2*y)*w*4; const unsigned char* p1=p0+(size_t)w*4;
+        for(int x=0;x<w/2;x++){
+            int b=p0[8*x]+p0[8*x+4]+p1[8*x]+p1[8*x+4];
+            int g=p0[8*x+1]+p0[8*x+5]+p1[8*x+1]+p1[8*x+5];
+            int r=p0[8*x+2]+p0[8*x+6]+p1[8*x+2]+p1[8*x+6];
+            U[(size_t)y*(w/2)+x]=(unsigned char)clampi(((-43*r-85*g+128*b)>>10)+128,0,255);
+            V[(size_t)y*(w/2)+x]=(unsigned char)clampi(((128*r-107*g-21*b)>>10)+128,0,255);
+        }
+    }
+}
+
+/* PNG sin zlib: filtro 0 por fila e IDAT con bloques deflate "stored".
+   Pesa lo mismo que el PPM, pero cualquier visor o editor lo abre. */
+typedef struct { FILE* fp; unsigned long crc, a, b; size_t resto, enBloque; } PngZ;
+static unsigned long gCrcTab[256];
+
+static void PngCrcInit(void){
+    for(unsigned long n=0;n<256;n++){
+        unsigned long c=n;
+        for(int k=0;k<8;k++) c = (c&1)? 0xEDB88320UL^(c>>1) : c>>1;
+        gCrcTab[n]=c;
+    }
+}
+static BOOL PngPut(PngZ* z,const unsigned char* p,size_t n){
+    for(size_t i=0;i<n;i++) z->crc=gCrcTab[(z->crc^p[i])&0xFF]^(z->crc>>8);
+    return fwrite(p,1,n,z->fp)==n;
+}
+static BOOL PngU32(PngZ* z,unsigned long v){
+    unsigned char q[4]={(unsigned char)(v>>24),(unsigned char)(v>>16),(unsigned char)(v>>8),(unsigned char)v};
+    return PngPut(z,q,4);
+}
+/* Bytes crudos del flujo zlib: abre bloques de hasta 65535 y lleva el Adler-32 */
+static BOOL PngCrudo(PngZ* z,const unsigned char* p,size_t n){
+    BOOL ok=TRUE;
+    while(n){
+        if(z->enBloque==0){
+            size_t m=z->resto<65535? z->resto : 65535;
+            unsigned char h[5]={(unsigned char)(m==z->resto),(unsigned char)m,(unsigned char)(m>>8),
+                                (unsigned char)~m,(unsigned char)(~m>>8)};
+            ok&=PngPut(z,h,5); z->enBloque=m; z->resto-=m;
+        }
+        size_t k=n<z->enBloque? n : z->enBloque;
+        for(size_t i=0;i<k;){
+            size_t fin=i+5552<k? i+5552 : k;          /* sin desborde antes del módulo */
+            for(;i<fin;i++){ z->a+=p[i]; z->b+=z->a; }
+            z->a%=65521; z->b%=65521;
+        }
+        ok&=PngPut(z,p,k); p+=k; n-=k; z->enBloque-=k;
+    }
+    return ok;
+}
+static BOOL WritePng(FILE* fp,const unsigned char* rgb,int w,int h){
+    static const unsigned char firma[8]={137,'P','N','G',13,10,26,10};
+    PngZ z={fp,0,1,0,0,0};
+    size_t fila=(size_t)w*3, crudo=(size_t)h*(fila+1), bloques=(crudo+65534)/65535;
+    unsigned char ihdr[13]={(unsigned char)(w>>24),(unsigned char)(w>>16),(unsigned char)(w>>8),(unsigned char)w,
+                            (unsigned char)(h>>24),(unsigned char)(h>>16),(unsigned char)(h>>8),(unsigned char)h,
+                            8,2,0,0,0};
+    static const unsigned char zcab[2]={0x78,0x01}, filtro=0;
+    BOOL ok=fwrite(firma,1,8,fp)==8;
+    ok&=PngU32(&z,13); z.crc=0xFFFFFFFFUL; ok&=PngPut(&z,(const unsigned char*)"IHDR",4);
+    ok&=PngPut(&z,ihdr,13); ok&=PngU32(&z,z.crc^0xFFFFFFFFUL);
+    ok&=PngU32(&z,(unsigned long)(2+crudo+5*bloques+4)); z.crc=0xFFFFFFFFUL;
+    ok&=PngPut(&z,(const unsigned char*)"IDAT",4); ok&=PngPut(&z,zcab,2);
+    z.resto=crudo;
+    for(int y=0;y<h && ok;y++){ ok&=PngCrudo(&z,&filtro,1); ok&=PngCrudo(&z,rgb+(size_t)y*fila,fila); }
+    ok&=PngU32(&z,(z.b<<16)|z.a); ok&=PngU32(&z,z.crc^0xFFFFFFFFUL);
+    ok&=PngU32(&z,0); z.crc=0xFFFFFFFFUL; ok&=PngPut(&z,(const unsigned char*)"IEND",4); ok&=PngU32(&z,z.crc^0xFFFFFFFFUL);
+    return ok;
+}
+
+static DWORD WINAPI EncoderThread(LPVOID arg){
+    FrameQueue* Q=(FrameQueue*)arg;
+    const OfflineCfg* c=Q->cfg;
+    size_t outBytes = c->fmt==OUT_Y4M ? (size_t)c->w*c->h*3/2 : (size_t)c->w*c->h*3;
+    EnterCriticalSection(&Q->cs);
+    unsigned char* tmp=Q->tmp[Q->sigTmp++];               /* reservado por RunOffline */
+    LeaveCriticalSection(&Q->cs);
+    for(;;){
+        EnterCriticalSection(&Q->cs);
+        while(Q->nListos==0 && !Q->fin) SleepConditionVariableCS(&Q->hayListo,&Q->cs,INFINITE);
+        if(Q->nListos==0){ LeaveCriticalSection(&Q->cs); break; }
+        int s=Q->listos[Q->cab]; Q->cab=(Q->cab+1)%c->queue; Q->nListos--;
+        int f=Q->frameDe[s];
+        LeaveCriticalSection(&Q->cs);
+
+        if(c->fmt==OUT_Y4M) ToYUV420(Q->slot[s],tmp,c->w,c->h); else ToRGB24(Q->slot[s],tmp,c->w,c->h);
+
+        /* El buffer ya se convirtió: vuelve al render antes de tocar disco */
+        EnterCriticalSection(&Q->cs);
+        Q->libres[Q->nLibres++]=s;
+        WakeConditionVariable(&Q->hayLibre);
+        LeaveCriticalSection(&Q->cs);
+
+        BOOL ok=TRUE;
+        if(c->fmt==OUT_Y4M){
+            EnterCriticalSection(&Q->cs);
+            while(Q->sigEscribir!=f) SleepConditionVariableCS(&Q->turno,&Q->cs,INFINITE);
+            LeaveCriticalSection(&Q->cs);
+            ok = fputs("FRAME\n",Q->y4m)>=0 && fwrite(tmp,1,outBytes,Q->y4m)==outBytes;
+            EnterCriticalSection(&Q->cs);
+            Q->sigEscribir++;
+            WakeAllConditionVariable(&Q->turno);
+            LeaveCriticalSection(&Q->cs);
+        }else{
+            char path[MAX_PATH+32];
+            sprintf(path,"%s/frame_%06d.%s",c->out,f,c->fmt==OUT_PNG?"png":"ppm");
+            FILE* fp=fopen(path,"wb");
+            ok = fp!=NULL;
+            if(fp && c->fmt==OUT_PNG) ok=WritePng(fp,tmp,c->w,c->h);
+            else if(fp){ fprintf(fp,"P6\n%d %d\n255\n",c->w,c->h); ok=fwrite(tmp,1,outBytes,fp)==outBytes; }
+            if(fp && fclose(fp)!=0) ok=FALSE;
+        }
+        if(!ok){ EnterCriticalSection(&Q->cs); Q->errores++; LeaveCriticalSection(&Q->cs); }
+    }
+    return 0;
+}
+
+static double QpcSeconds(LARGE_INTEGER a,LARGE_INTEGER b,LARGE_INTEGER f){ return (double)(b.QuadPart-a.QuadPart)/(double)f.QuadPart; }
+
+/* Reserva la cola (buffers de cuadro y de codificador) y abre la salida */
+static BOOL OpenOffline(FrameQueue* Q,const OfflineCfg* c){
+    size_t frameBytes=(size_t)c->w*c->h*4, outBytes=(size_t)c->w*c->h*3;
+    Q->slot=(unsigned char**)calloc(c->queue,sizeof(unsigned char*));
+    Q->tmp=(unsigned char**)calloc(c->encoders,sizeof(unsigned char*));
+    Q->frameDe=(int*)calloc(c->queue,sizeof(int));
+    Q->libres=(int*)calloc(c->queue,sizeof(int));
+    Q->listos=(int*)calloc(c->queue,sizeof(int));
+    BOOL ok = Q->slot && Q->tmp && Q->frameDe && Q->libres && Q->listos;
+    for(int k=0;ok && k<c->queue;k++){ ok=(Q->slot[k]=(unsigned char*)malloc(frameBytes))!=NULL; Q->libres[Q->nLibres++]=k; }
+    for(int k=0;ok && k<c->encoders;k++) ok=(Q->tmp[k]=(unsigned char*)malloc(outBytes))!=NULL;
+    if(!ok){ fprintf(stderr,"offline: sin memoria para %d cuadros en cola\n",c->queue); return FALSE; }
+
+    if(c->fmt==OUT_Y4M){
+        Q->y4m=fopen(c->out,"wb");
+        if(!Q->y4m){ fprintf(stderr,"offline: no se pudo abrir %s\n",c->out); return FALSE; }
+        fprintf(Q->y4m,"YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg\n",c->w,c->h,1000,FRAME_MS);
+    }else{
+        CreateDirectoryA(c->out,NULL);
+        if(c->fmt==OUT_PNG) PngCrcInit();
+    }
+    return TRUE;
+}
+
+/* Libera la cola y la escena; admite una cola a medio reservar (todo a NULL) */
+static void CloseOffline(FrameQueue* Q,const OfflineCfg* c){
+    if(Q->y4m) fclose(Q->y4m);
+    DeleteCriticalSection(&Q->cs);
+    if(Q->slot) for(int k=0;k<c->queue;k++) free(Q->slot[k]);
+    if(Q->tmp) for(int k=0;k<c->encoders;k++) free(Q->tmp[k]);
+    free(Q->slot); free(Q->tmp); free(Q->frameDe); free(Q->libres); free(Q->listos);
+    FreeBalls();
+    ParticlesFree();
+    FreeLodLayer();
+    if(trailDC){ SelectObject(trailDC,trailOld); DeleteObject(trailBMP); DeleteDC(trailDC); trailDC=NULL; }
+    SelectObject(backDC,backOld); DeleteObject(backBMP); DeleteDC(backDC); backDC=NULL;
+}
+
+/* Corre la simulación a paso fijo y entrega cada cuadro a la cola */
+static int RunOffline(const OfflineCfg* c){
+    width=c->w; height=c->h;
+    if(!InitOffscreen(width,height)){ fprintf(stderr,"offline: no se pudo crear el framebuffer %dx%d\n",width,height); return 1; }
+
+    FrameQueue Q; memset(&Q,0,sizeof(Q));
+    Q.cfg=c;
+    size_t frameBytes=(size_t)width*height*4;
+    InitializeCriticalSection(&Q.cs);
+    InitializeConditionVariable(&Q.hayLibre); InitializeConditionVariable(&Q.hayListo); InitializeConditionVariable(&Q.turno);
+    if(!InitBalls() || !OpenOffline(&Q,c)){ CloseOffline(&Q,c); return 1; }
+
+    /* Los hilos que no arrancan se descartan; sin ninguno no hay quien vacíe la cola */
+    HANDLE th[64]; int hilos=0;                 /* -enc ya viene acotado a 64 */
+    for(int k=0;k<c->encoders;k++){
+        HANDLE t=CreateThread(NULL,0,EncoderThread,&Q,0,NULL);
+        if(t) th[hilos++]=t;
+    }
+    if(hilos==0){ fprintf(stderr,"offline: no arrancó ningún codificador\n"); CloseOffline(&Q,c); return 1; }
+    if(hilos<c->encoders) fprintf(stderr,"offline: arrancaron %d de %d codificadores\n",hilos,c->encoders);
+
+    LARGE_INTEGER qpf,t0,t1,w0,w1; QueryPerformanceFrequency(&qpf); QueryPerformanceCounter(&t0);
+    const double dt=FRAME_MS/1000.0;
+    double espera=0.0, fps=0.0; int esperas=0;
+    for(int f=0;f<c->frames;f++){
+        gTime+=dt;
+        Frame(dt,fps);
+        GdiFlush();
+
+        EnterCriticalSection(&Q.cs);
+        if(Q.nLibres==0){
+            esperas++; QueryPerformanceCounter(&w0);
+            while(Q.nLibres==0) SleepConditionVariableCS(&Q.hayLibre,&Q.cs,INFINITE);
+            QueryPerformanceCounter(&w1); espera+=QpcSeconds(w0,w1,qpf);
+        }
+        int s=Q.libres[--Q.nLibres];
+        LeaveCriticalSection(&Q.cs);
+
+        memcpy(Q.slot[s],backBits,frameBytes);
+
+        EnterCriticalSection(&Q.cs);
+        Q.frameDe[s]=f;
+        Q.listos[(Q.cab+Q.nListos)%c->queue]=s; Q.nListos++;
+        WakeConditionVariable(&Q.hayListo);
+        LeaveCriticalSection(&Q.cs);
+
+        QueryPerformanceCounter(&t1);
+        double el=QpcSeconds(t0,t1,qpf); if(el>0) fps=(f+1)/el;
+    }
+    QueryPerformanceCounter(&t1); double segRender=QpcSeconds(t0,t1,qpf);
+
+    EnterCriticalSection(&Q.cs); Q.fin=1; WakeAllConditionVariable(&Q.hayListo); LeaveCriticalSection(&Q.cs);
+    for(int k=0;k<hilos;k++){ WaitForSingleObject(th[k],INFINITE); CloseHandle(th[k]); }
+    if(Q.y4m && fclose(Q.y4m)!=0) Q.errores++;
+    Q.y4m=NULL;
+    QueryPerformanceCounter(&t1); double segTotal=QpcSeconds(t0,t1,qpf);
+
+    static const char* FORMATOS[]={"ppm","y4m","png"};
+    printf("offline: %d cuadros %dx%d -> %s (%s), %d codificadores, cola %d\n",
+           c->frames,width,height,c->out,FORMATOS[c->fmt],hilos,c->queue);
+    printf("  render %.3f s (%.1f cuadros/s), total %.3f s (%.1f cuadros/s)\n",
+           segRender,c->frames/segRender,segTotal,c->frames/segTotal);
+    printf("  render esperó cola llena %d veces (%.3f s), errores de escritura %d\n",esperas,espera,Q.errores);
+    printf("  cuadro: %s\n",(gGrafo && !gLod)? "grafo de tareas" : "fases en secuencia");
+    LtResumen(stdout,"  linea de tiempo: ");
+
+    CloseOffline(&Q,c);
+    return Q.errores?1:0;
+}
+
+/* Valor que sigue a la opción 'key' en la línea de comandos (o NULL) */
+static const char* CmdArg(LPSTR cmd,const char* key){
+    if(!cmd) return NULL;
+    size_t k=strlen(key);
+    for(const char* p=strstr(cmd,key); p; p=strstr(p+1,key)){
+        BOOL ini=(p==cmd || p[-1]==' '), fin=(p[k]==' ' || p[k]==0);
+        if(ini && fin){ p+=k; while(*p==' ') p++; return p; }
+    }
+    return NULL;
+}
+
+/* -offline F [-out RUTA] [-fmt ppm|y4m|png] [-enc K] [-cola Q] [-tam WxH] */
+static BOOL ParseOffline(LPSTR cmd,OfflineCfg* c){
+    const char* v=CmdArg(cmd,"-offline");
+    if(!v) return FALSE;
+    memset(c,0,sizeof(*c));
+    c->frames=atoi(v); if(c->frames<=0) c->frames=600;
+    c->w=960; c->h=560; c->fmt=OUT_PPM; c->encoders=4; c->queue=8;
+    if((v=CmdArg(cmd,"-fmt")) && strncmp(v,"y4m",3)==0) c->fmt=OUT_Y4M;
+    else if(v && strncmp(v,"png",3)==0) c->fmt=OUT_PNG;
+    if((v=CmdArg(cmd,"-enc"))) c->encoders=clampi(atoi(v),1,64);
+    if((v=CmdArg(cmd,"-cola"))) c->queue=clampi(atoi(v),1,1024);
+    if((v=CmdArg(cmd,"-tam"))) sscanf(v,"%dx%d",&c->w,&c->h);
+    c->w=clampi(c->w,16,7680)&~1; c->h=clampi(c->h,16,4320)&~1;
+    strcpy(c->out, c->fmt==OUT_Y4M ? "render.y4m" : "frames");
+    if((v=CmdArg(cmd,"-out"))) sscanf(v,"%259s",c->out);
+    return TRUE;
+}
+
+/* -efectos estela,chispas,viento,jitter (los no listados se apagan) */
+static unsigned ParseEffects(LPSTR cmd){
+    unsigned fx=gFx;
+    const char* v=CmdArg(cmd,"-efectos");
+    if(!v) return fx;
+    char lista[128]={0}; sscanf(v,"%127s",lista);
+    unsigned pedido=0;
+    if(strstr(lista,"estela")) pedido|=FX_TRAILS;
+    if(strstr(lista,"chispas")) pedido|=FX_SPARKS;
+    if(strstr(lista,"viento")) pedido|=FX_WIND;
+    if(strstr(lista,"jitter")) pedido|=FX_JITTER;
+    return fx & pedido;
+}
+
 /* Lee N desde la línea de comandos */
 static int ParseN(LPSTR lpCmdLine){
     if(!lpCmdLine||!*lpCmdLine) return DEF_N;
@@ -480,9 +1412,45 @@ static int ParseN(LPSTR lpCmdLine){
     return (int)v;
 }
 
+/* Modo de estela desde la línea de comandos ("acum" tras N) */
+static int ParseTrailMode(LPSTR lpCmdLine){
+    if(lpCmdLine && strstr(lpCmdLine,"acum")) return TRAIL_ACUM;
+    return TRAIL_PUNTOS;
+}
+
+/* Decide el modo LOD tras conocer N ([-lod U] cambia el umbral; 0 lo fuerza).
+   Estela, chispas y jitter se apagan: su costo es por bola (estampas, ráfagas,
+   sorteos) y a esta escala no se distinguen en el mapa. Sin estela tampoco
+   se reserva la historia de puntos (InitBalls). */
+static void ConfigLod(LPSTR cmd){
+    const char* v=CmdArg(cmd,"-lod");
+    if(v) gLodUmbral=atoi(v)<0? 0 : atoi(v);
+    gLod=N>gLodUmbral;
+    gLodPaso=gLod? (N+LOD_SPRITES-1)/LOD_SPRITES : 1;
+    if(gLod) gFx&=~(unsigned)(FX_TRAILS|FX_SPARKS|FX_JITTER);
+}
+
+/* [-secuencial] cuadro por fases; [-linea_tiempo archivo.csv] tareas por cuadro */
+static void ParseFrameOpts(LPSTR cmd){
+    gGrafo=CmdArg(cmd,"-secuencial")==NULL;
+    const char* v=CmdArg(cmd,"-linea_tiempo");
+    if(v && !LtAbrir(v)) fprintf(stderr,"no se pudo abrir la línea de tiempo\n");
+}
+
 /* Programa principal */
 int WINAPI WinMain(HINSTANCE hInst,HINSTANCE hPrev,LPSTR lpCmd,int nShow){
     (void)hPrev;
+    OfflineCfg off;
+    if(ParseOffline(lpCmd,&off)){
+        N=ParseN(lpCmd);
+        gTrailMode=ParseTrailMode(lpCmd);
+        gFx=ParseEffects(lpCmd); ConfigLod(lpCmd); SelectBallKernel();
+        ParseFrameOpts(lpCmd);
+        int rc=RunOffline(&off);
+        LtCerrar();
+        return rc;
+    }
+
     const char* CLASS_NAME="SequentialEmitterWnd_OMP";
     WNDCLASSA wc={0};
     wc.lpfnWndProc=WndProc; wc.hInstance=hInst; wc.hCursor=LoadCursor(NULL,IDC_ARROW);
@@ -497,7 +1465,10 @@ int WINAPI WinMain(HINSTANCE hInst,HINSTANCE hPrev,LPSTR lpCmd,int nShow){
     ShowWindow(hwnd,nShow); UpdateWindow(hwnd);
     ResizeRecreate();
     N=ParseN(lpCmd);
-    InitBalls();
+    gTrailMode=ParseTrailMode(lpCmd);
+    gFx=ParseEffects(lpCmd); ConfigLod(lpCmd); SelectBallKernel();
+    ParseFrameOpts(lpCmd);
+    if(!InitBalls()) running=FALSE;        /* InitBalls ya avisó; se limpia abajo */
 
     LARGE_INTEGER qpf; QueryPerformanceFrequency(&qpf);
     LARGE_INTEGER last; QueryPerformanceCounter(&last);
@@ -515,11 +1486,7 @@ int WINAPI WinMain(HINSTANCE hInst,HINSTANCE hPrev,LPSTR lpCmd,int nShow){
         double dt=(double)(now.QuadPart-last.QuadPart)/(double)qpf.QuadPart; last=now;
 
         gTime+=dt;
-        UpdatePhysics(dt);
-        DrawBackground();
-        int active=0; DrawBalls(&active);
-        ParticlesDraw();
-        DrawHUD(fps,active);
+        Frame(dt,fps);
 
         HDC wndDC=GetDC(hwnd); Present(wndDC); ReleaseDC(hwnd,wndDC);
 
@@ -531,6 +1498,10 @@ int WINAPI WinMain(HINSTANCE hInst,HINSTANCE hPrev,LPSTR lpCmd,int nShow){
     }
 
     FreeBalls();
+    ParticlesFree();
+    FreeLodLayer();
+    LtCerrar();
     if(backDC){ SelectObject(backDC,backOld); DeleteObject(backBMP); DeleteDC(backDC); }
+    if(trailDC){ SelectObject(trailDC,trailOld); DeleteObject(trailBMP); DeleteDC(trailDC); }
     return 0;
 }
\ No newline at end of file